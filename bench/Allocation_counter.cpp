@@ -0,0 +1,84 @@
+#include "Allocation_counter.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new for the whole benchmark executable. The
+// other forms (nothrow, arrays) forward to these two by default, and every
+// operator delete ends in free().
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+void* allocate(std::size_t size, std::size_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    size = std::max<std::size_t>(size, 1);
+
+    void* pointer{nullptr};
+    if (alignment <= alignof(std::max_align_t)) {
+        pointer = std::malloc(size);
+    }
+    else {
+        // aligned_alloc wants a multiple of the alignment
+        const auto rounded = (size + alignment - 1) / alignment * alignment;
+        pointer = std::aligned_alloc(alignment, rounded);
+    }
+
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+}  // namespace
+
+uint64_t allocation_count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void report_allocations(benchmark::State& state, uint64_t start)
+{
+    state.counters["allocs"] = benchmark::Counter(
+      static_cast<double>(allocation_count() - start),
+      benchmark::Counter::kAvgIterations
+    );
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t /*size*/) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t /*alignment*/) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(
+  void* pointer, std::size_t /*size*/, std::align_val_t /*alignment*/
+) noexcept
+{
+    std::free(pointer);
+}
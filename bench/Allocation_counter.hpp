@@ -0,0 +1,17 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+/// @brief Heap allocations made by the whole process so far, through any form
+/// of operator new
+///
+/// Benchmarks take the difference around their timed loop to report
+/// allocations per iteration, which should be 0 once a hot path has warmed up.
+[[nodiscard]]
+uint64_t allocation_count();
+
+/// @brief Sets state's "allocs" counter to the allocations per iteration since
+/// allocation_count() was start
+void report_allocations(benchmark::State& state, uint64_t start);
@@ -0,0 +1,191 @@
+#include "Allocation_counter.hpp"
+#include "Client.hpp"
+#include "Interpolation_buffer.hpp"
+#include "Local_transport.hpp"
+#include "Server_update.hpp"
+#include "Snapshot.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The client side of a snapshot: receiving it, reconstructing it and rendering
+// remote entities between two of them.
+
+namespace {
+
+using namespace std::chrono_literals;
+
+std::shared_ptr<Update_storage> make_storage(std::size_t entities)
+{
+    auto storage = std::make_shared<Update_storage>();
+    storage->states.reserve(entities);
+    for (std::size_t id = 0; id < entities; ++id) {
+        storage->states.push_back({.position = static_cast<double>(id), .id = id});
+    }
+    return storage;
+}
+
+// Updates processed before timing, enough to fill the snapshot history and
+// the interpolation buffer so nothing grows any more
+constexpr std::size_t warm_up_updates{
+  std::max(snapshot_history_size, default_interpolation_capacity) + 8};
+
+// A full snapshot every tick, as sent before the client has acknowledged any.
+// range(0): entities
+void BM_client_process_full(benchmark::State& state)
+{
+    const auto entities = static_cast<std::size_t>(state.range(0));
+    const std::shared_ptr<const Update_storage> storage = make_storage(entities);
+
+    Client client;
+    client.entity_id(0);
+
+    Server_update update;
+    update.storage = storage;
+    update.states = storage->states;
+
+    const auto process = [&] {
+        ++update.tick;
+        client.send(update, 0us);
+        client.process_server_messages();
+    };
+
+    for (std::size_t i = 0; i < warm_up_updates; ++i) {
+        process();
+    }
+
+    const auto allocations = allocation_count();
+    for (auto _ : state) {
+        process();
+    }
+    report_allocations(state, allocations);
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Deltas against the previous tick, with one entity in sixteen changed.
+// range(0): entities
+void BM_client_process_delta(benchmark::State& state)
+{
+    const auto entities = static_cast<std::size_t>(state.range(0));
+    const std::shared_ptr<const Update_storage> full = make_storage(entities);
+
+    auto changed = std::make_shared<Update_storage>();
+    for (std::size_t id = 0; id < entities; id += 16) {
+        changed->states.push_back(full->states[id]);
+    }
+    const std::shared_ptr<const Update_storage> delta = changed;
+
+    Client client;
+    client.entity_id(0);
+
+    Server_update update;
+    update.storage = full;
+    update.states = full->states;
+    update.tick = 1;
+    client.send(update, 0us);
+    client.process_server_messages();
+
+    update.storage = delta;
+    update.states = delta->states;
+
+    const auto process = [&] {
+        update.baseline_tick = update.tick;
+        ++update.tick;
+        client.send(update, 0us);
+        client.process_server_messages();
+    };
+
+    for (std::size_t i = 0; i < warm_up_updates; ++i) {
+        process();
+    }
+
+    const auto allocations = allocation_count();
+    for (auto _ : state) {
+        process();
+    }
+    report_allocations(state, allocations);
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// What Client::interpolate_entities does each frame once it has snapshots on
+// both sides of the render time: find them, then blend every entity.
+// range(0): entities
+void BM_client_interpolate(benchmark::State& state)
+{
+    const auto entities = static_cast<std::size_t>(state.range(0));
+    const auto storage = make_storage(entities);
+
+    constexpr auto interval = 16ms;
+
+    Interpolation_buffer buffer;
+    const auto capacity = static_cast<int>(buffer.capacity());
+    const auto start = Interpolation_buffer::time_point{} + 1h;
+    for (int i = 0; i < capacity; ++i) {
+        buffer.push(start + i * interval, storage->states, entities);
+    }
+
+    // Halfway between two snapshots in the middle of the buffer
+    const Interpolation_buffer::render_time_point render_time =
+      start + (capacity / 2) * interval + interval / 2;
+    std::vector<double> positions(entities);
+
+    for (auto _ : state) {
+        const auto index = buffer.bracket(render_time);
+        buffer.interpolate(*index, render_time, positions);
+        benchmark::DoNotOptimize(positions.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Handing an update to a client through the local transport and its link
+// emulator, drained every so often like a client frame would.
+// range(0): entities in the update
+void BM_local_transport_send(benchmark::State& state)
+{
+    const auto entities = static_cast<std::size_t>(state.range(0));
+    const std::shared_ptr<const Update_storage> storage = make_storage(entities);
+
+    Client client;
+    client.entity_id(0);
+
+    Local_server_transport transport;
+    transport.attach(0, &client);
+
+    Server_update update;
+    update.storage = storage;
+    update.states = storage->states;
+
+    // Tick 0 is never newer than what the client holds, so updates are dropped
+    // without being reconstructed and the drain only measures the queues
+    update.tick = 0;
+
+    std::size_t pending{0};
+    const auto allocations = allocation_count();
+    for (auto _ : state) {
+        transport.send(0, update);
+
+        if (++pending == client_inbound_capacity / 2) {
+            client.process_server_messages();
+            pending = 0;
+        }
+    }
+    report_allocations(state, allocations);
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK(BM_client_process_full)->RangeMultiplier(10)->Range(1, 100000);
+BENCHMARK(BM_client_process_delta)->RangeMultiplier(10)->Range(16, 100000);
+BENCHMARK(BM_client_interpolate)->RangeMultiplier(10)->Range(1, 100000);
+BENCHMARK(BM_local_transport_send)->RangeMultiplier(10)->Range(1, 100000);
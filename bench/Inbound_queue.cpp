@@ -0,0 +1,124 @@
+#include "Command_message.hpp"
+#include "common.hpp"
+#include "Delay_queue.hpp"
+#include "Mpsc_queue.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Many threads sending client messages to one consumer, the way transports
+// feed Server::send while Server::update drains.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The hand-off Server and Client used before: every send takes the mutex the
+// consumer holds while popping
+struct Mutex_inbound {
+    std::mutex mutex;
+    Delay_queue<Client_message> queue;
+
+    void push(const Client_message& msg, Clock::time_point due)
+    {
+        const std::scoped_lock lock(mutex);
+        queue.push(msg, due);
+    }
+
+    void consume(std::vector<Client_message>& due)
+    {
+        const std::scoped_lock lock(mutex);
+        queue.pop_due(Clock::now(), due);
+    }
+};
+
+// What they use now: producers only touch the lock-free queue
+struct Lock_free_inbound {
+    using Arrival = std::pair<Client_message, Clock::time_point>;
+
+    Mpsc_queue<Arrival> inbound{8192};
+    Delay_queue<Client_message> queue;
+
+    void push(const Client_message& msg, Clock::time_point due)
+    {
+        // Retry instead of dropping, so both sides do the same work
+        while (!inbound.try_push({msg, due})) {
+            std::this_thread::yield();
+        }
+    }
+
+    void consume(std::vector<Client_message>& due)
+    {
+        inbound.drain([this](Arrival&& arrival) {
+            queue.push(arrival.first, arrival.second);
+        });
+        queue.pop_due(Clock::now(), due);
+    }
+};
+
+// Shared by the benchmark threads, set up by thread 0 before they all start
+template <typename Inbound>
+struct Contention {
+    Inbound inbound;
+    std::atomic<bool> stop{false};
+    std::thread consumer;
+
+    Contention()
+      : consumer([this] {
+          std::vector<Client_message> due;
+          while (!stop.load(std::memory_order_relaxed)) {
+              due.clear();
+              inbound.consume(due);
+          }
+      })
+    {}
+
+    DISABLE_COPY(Contention);
+    DISABLE_MOVE(Contention);
+
+    ~Contention()
+    {
+        stop = true;
+        consumer.join();
+    }
+};
+
+template <typename Inbound>
+void BM_inbound_send(benchmark::State& state)
+{
+    static std::unique_ptr<Contention<Inbound>> contention;
+
+    if (state.thread_index() == 0) {
+        contention = std::make_unique<Contention<Inbound>>();
+    }
+
+    Client_message msg{
+      .entity_id = static_cast<std::size_t>(state.thread_index()),
+      .duration = std::chrono::duration<double>{1.0 / 60.0},
+      .sequence_number = 0};
+
+    // Benchmark threads wait for each other at the start and end of the loop,
+    // so the consumer outlives every send
+    for (auto _ : state) {
+        ++msg.sequence_number;
+        contention->inbound.push(msg, Clock::now());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        contention.reset();
+    }
+}
+
+}  // namespace
+
+BENCHMARK(BM_inbound_send<Mutex_inbound>)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_inbound_send<Lock_free_inbound>)->ThreadRange(1, 16)->UseRealTime();
@@ -0,0 +1,65 @@
+#include "Link_emulator.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstddef>
+
+// Cost of deciding the fate of one packet, the overhead the emulator adds to
+// every message sent through a local transport.
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr std::size_t packet_bytes{200};
+
+// 10 Gbit/s: enough that the bucket never runs dry, so only its bookkeeping is
+// measured
+constexpr double uncapped_bandwidth{1.25e9};
+
+Link_config bench_config(int64_t features)
+{
+    Link_config config{.latency = 50ms};
+
+    if (features >= 1) {
+        config.jitter = 10ms;
+        config.distribution = Jitter_distribution::normal;
+    }
+
+    if (features >= 2) {
+        config.loss = 0.01;
+        config.burst_start = 0.001;
+        config.burst_end = 0.2;
+        config.duplicate = 0.01;
+        config.reorder = 0.01;
+    }
+
+    if (features >= 3) {
+        config.bandwidth = uncapped_bandwidth;
+    }
+
+    return config;
+}
+
+// range(0): 0 = fixed latency, 1 = + jitter, 2 = + loss, duplication and
+// reordering, 3 = + bandwidth cap
+void BM_link_transmit(benchmark::State& state)
+{
+    Link_emulator link(bench_config(state.range(0)));
+    auto now = Link_emulator::clock::now();
+
+    for (auto _ : state) {
+        now += 1us;
+        benchmark::DoNotOptimize(link.transmit(packet_bytes, now));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(
+      state.iterations() * static_cast<int64_t>(packet_bytes)
+    );
+}
+
+}  // namespace
+
+BENCHMARK(BM_link_transmit)->DenseRange(0, 3);
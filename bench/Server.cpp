@@ -0,0 +1,170 @@
+#include "Allocation_counter.hpp"
+#include "Command_message.hpp"
+#include "Server.hpp"
+#include "Snapshot.hpp"
+#include "Transport.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// One server tick: applying the inputs handed to it, then building and fanning
+// out every client's update. The transport drops updates, so the cost of
+// encoding or delivering them is left to the other benchmarks.
+
+namespace {
+
+using namespace std::chrono_literals;
+
+class Null_transport final : public Server_transport {
+public:
+    void send(std::size_t /*entity_id*/, Server_update const& update) override
+    {
+        benchmark::DoNotOptimize(update.states.data());
+    }
+
+    void flush() override {}
+    void poll(Server& /*server*/) override {}
+};
+
+// Every client spaced this far apart
+constexpr double spawn_spacing{1.0};
+
+// Ticks run before timing, enough for every buffer and pool to reach its
+// steady-state size: a full snapshot history, and then some
+constexpr uint32_t warm_up_ticks{snapshot_history_size + 8};
+
+constexpr std::chrono::duration<double> tick_interval{1.0 / 60.0};
+
+// Clients holding their key down for a whole 60 Hz tick
+struct Simulated_input {
+    uint32_t sequence_number{0};
+
+    void send(Server& server, std::size_t entity_id)
+    {
+        Input_batch batch{
+          .entity_id = entity_id,
+          .last_sequence_number = sequence_number,
+          .count = 1,
+          .durations = {}};
+        batch.durations[0] = tick_interval;
+        server.send(batch, 0us);
+    }
+};
+
+// Connects clients spaced apart, after configure has set up the feature under
+// test, then times one tick per iteration once warmed up. Each tick the first
+// active clients send an input and acknowledge the previous update, the rest
+// are idle.
+template <typename Configure>
+void run_ticks(
+  benchmark::State& state,
+  std::size_t clients,
+  std::size_t active,
+  Configure const& configure
+)
+{
+    Null_transport transport;
+    Server server(transport);
+    server.tick_interval(tick_interval);
+    configure(server);
+    for (std::size_t i = 0; i < clients; ++i) {
+        server.connect(static_cast<double>(i) * spawn_spacing);
+    }
+
+    Simulated_input input;
+    uint32_t tick{0};
+
+    const auto run_tick = [&] {
+        ++input.sequence_number;
+        for (std::size_t id = 0; id < active; ++id) {
+            input.send(server, id);
+            if (tick != 0) {
+                server.send(Client_ack{.entity_id = id, .tick = tick}, 0us);
+            }
+        }
+
+        server.update();
+        ++tick;
+    };
+
+    while (tick < warm_up_ticks) {
+        run_tick();
+    }
+
+    const auto allocations = allocation_count();
+    const auto before = server.stats();
+    for (auto _ : state) {
+        run_tick();
+    }
+    report_allocations(state, allocations);
+
+    const auto& after = server.stats();
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(clients));
+    state.counters["states_sent"] = benchmark::Counter(
+      static_cast<double>(after.states_sent - before.states_sent),
+      benchmark::Counter::kAvgIterations
+    );
+    state.counters["states_deferred"] = benchmark::Counter(
+      static_cast<double>(after.states_deferred - before.states_deferred),
+      benchmark::Counter::kAvgIterations
+    );
+}
+
+// Every client active: each tick it sends an input and acknowledges the
+// previous update, so it is sent deltas of the whole world.
+// range(0): clients, each with its own entity
+void BM_server_update(benchmark::State& state)
+{
+    const auto clients = static_cast<std::size_t>(state.range(0));
+    run_ticks(state, clients, clients, [](Server& /*server*/) {});
+}
+
+// Large worlds, where each client is only sent the entities near it. Only the
+// first active clients send inputs and acks, the rest are idle and keep being
+// sent their full neighbourhood.
+// range(0): entities, one per client, range(1): active clients
+void BM_server_update_interest(benchmark::State& state)
+{
+    const auto entities = static_cast<std::size_t>(state.range(0));
+    const auto active =
+      std::min(entities, static_cast<std::size_t>(state.range(1)));
+
+    run_ticks(state, entities, active, [](Server& server) {
+        // Around 32 entities in range of each client
+        server.interest(
+          {.radius = 16.0 * spawn_spacing, .hysteresis = spawn_spacing}
+        );
+    });
+}
+
+// As BM_server_update, but every update limited to a byte budget, so each
+// client's changes are ranked and most are deferred.
+// range(0): clients, each with its own entity, range(1): bytes per update
+void BM_server_update_budget(benchmark::State& state)
+{
+    const auto clients = static_cast<std::size_t>(state.range(0));
+    const auto bytes = static_cast<std::size_t>(state.range(1));
+
+    run_ticks(state, clients, clients, [bytes](Server& server) {
+        server.budget({.bytes = bytes});
+    });
+}
+
+}  // namespace
+
+BENCHMARK(BM_server_update)
+  ->RangeMultiplier(10)
+  ->Range(1, 1000)
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_server_update_interest)
+  ->ArgsProduct({{1000, 10000, 100000}, {1, 1000}})
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_server_update_budget)
+  ->ArgsProduct({{100, 1000}, {256, 1200}})
+  ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,72 @@
+#include "Wire_format.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Serializing updates, the per-client send cost of the UDP transport.
+
+namespace {
+
+struct Encoded_update {
+    std::shared_ptr<Update_storage> storage = std::make_shared<Update_storage>();
+    Server_update update;
+
+    explicit Encoded_update(std::size_t entities)
+    {
+        for (std::size_t id = 0; id < entities; ++id) {
+            storage->states.push_back(
+              {.position = static_cast<double>(id) * 0.75, .id = id}
+            );
+        }
+
+        update.storage = storage;
+        update.states = storage->states;
+        update.tick = 100;
+        update.last_processed_input = 1000;
+    }
+};
+
+// range(0): entities in the update
+void BM_wire_encode_update(benchmark::State& state)
+{
+    const Wire_format format;
+    const Encoded_update encoded(static_cast<std::size_t>(state.range(0)));
+    std::vector<std::byte> buffer(format.max_size(encoded.update));
+
+    std::size_t size{0};
+    for (auto _ : state) {
+        size = format.encode(encoded.update, buffer);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size));
+}
+
+// range(0): entities in the update
+void BM_wire_decode_update(benchmark::State& state)
+{
+    const Wire_format format;
+    const Encoded_update encoded(static_cast<std::size_t>(state.range(0)));
+    std::vector<std::byte> buffer(format.max_size(encoded.update));
+    buffer.resize(format.encode(encoded.update, buffer));
+
+    Server_update update;
+    Update_storage storage;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(format.decode(buffer, update, storage));
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(
+      state.iterations() * static_cast<int64_t>(buffer.size())
+    );
+}
+
+}  // namespace
+
+BENCHMARK(BM_wire_encode_update)->RangeMultiplier(10)->Range(1, 100000);
+BENCHMARK(BM_wire_decode_update)->RangeMultiplier(10)->Range(1, 100000);
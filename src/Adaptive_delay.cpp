@@ -0,0 +1,82 @@
+#include "Adaptive_delay.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Weight of each new interval, as RFC 3550 uses for its jitter estimate
+constexpr double arrival_gain{1.0 / 16.0};
+
+// How far the margin moves per frame, in standard deviations
+constexpr double margin_gain{0.05};
+constexpr double max_margin{10.0};
+
+// Jitter below this is treated as this much, so there is always a margin to
+// move when frames and snapshots drift in and out of phase
+constexpr double min_deviation_ms{1.0};
+
+}  // namespace
+
+Adaptive_delay::Adaptive_delay(const Adaptive_delay_config& config)
+  : _config(config)
+{}
+
+void Adaptive_delay::arrival(Clock::time_point time)
+{
+    if (_arrivals++ == 0) {
+        _last_arrival = time;
+        return;
+    }
+
+    // An update handed over from another thread after a later one was already
+    // processed arrives with it, intervals can't be negative
+    time = std::max(time, _last_arrival);
+    const double interval = milliseconds_d{time - _last_arrival}.count();
+    _last_arrival = time;
+
+    if (_arrivals == 2) {
+        _mean = interval;
+        return;
+    }
+
+    const double deviation = interval - _mean;
+    _mean += arrival_gain * deviation;
+    _variance += arrival_gain * (deviation * deviation - _variance);
+}
+
+milliseconds_d Adaptive_delay::delay(milliseconds_d initial)
+{
+    if (!_started) {
+        _delay = initial;
+    }
+    return _delay;
+}
+
+void Adaptive_delay::frame(Clock::time_point now, bool underrun)
+{
+    const auto elapsed = _started ? milliseconds_d{now - _last_frame}
+                                  : milliseconds_d{0.0};
+    _started = true;
+    _last_frame = now;
+
+    // Underruns before snapshots flow at all say nothing about the jitter
+    if (_arrivals < 2) {
+        return;
+    }
+
+    // Settles where underrun * (1 - target) balances the rest * target
+    const double target = _config.target_underrun_rate;
+    _margin += margin_gain * (underrun ? 1.0 - target : -target);
+    _margin = std::clamp(_margin, 0.0, max_margin);
+
+    const double deviation = std::max(std::sqrt(_variance), min_deviation_ms);
+    const milliseconds_d aim = std::clamp(
+      milliseconds_d{_mean + _margin * deviation},
+      _config.min_delay,
+      _config.max_delay
+    );
+
+    const auto step = elapsed * _config.max_slew;
+    _delay = std::clamp(aim, _delay - step, _delay + step);
+}
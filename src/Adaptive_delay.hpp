@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Clock.hpp"
+#include "common.hpp"
+
+#include <cstdint>
+
+/// @brief How the interpolation delay follows the link, see Adaptive_delay
+struct Adaptive_delay_config {
+    bool enabled{false};
+
+    // Fraction of frames that may find no snapshot after the render time
+    double target_underrun_rate{0.01};
+
+    // Most the delay may change per unit of time, so the render time runs at
+    // between 1 - max_slew and 1 + max_slew of real time
+    double max_slew{0.05};
+
+    milliseconds_d min_delay{0.0};
+    milliseconds_d max_delay{500.0};
+};
+
+/// @brief Interpolation delay tuned to the jitter of snapshot arrivals
+///
+/// The mean and variance of the time between arrivals are tracked as moving
+/// averages. The delay aims for the mean plus a margin of some number of
+/// standard deviations, and that number is tuned by every frame's outcome:
+/// raised on an underrun, lowered a little otherwise, so it settles where
+/// underruns happen at the target rate. The delay only moves towards its aim
+/// at max_slew, so entities speed up or slow down slightly rather than jump.
+class Adaptive_delay {
+public:
+    explicit Adaptive_delay(Adaptive_delay_config const& config = {});
+
+    [[nodiscard]]
+    bool enabled() const
+    {
+        return _config.enabled;
+    }
+
+    /// @brief Records a snapshot arriving at time, which is when it was due
+    /// rather than when it was processed, so updates processed together aren't
+    /// mistaken for a burst
+    void arrival(Clock::time_point time);
+
+    /// @brief The delay to render the current frame with
+    /// @param initial what to start from before the first frame()
+    [[nodiscard]]
+    milliseconds_d delay(milliseconds_d initial);
+
+    /// @brief Adapts the delay to how the frame rendered at now went
+    /// @param underrun whether the render time had no snapshot after it
+    void frame(Clock::time_point now, bool underrun);
+
+private:
+    Adaptive_delay_config _config;
+
+    bool _started{false};
+    milliseconds_d _delay{0.0};
+    Clock::time_point _last_frame{};
+
+    // Of the intervals between arrivals, in milliseconds
+    uint64_t _arrivals{0};
+    Clock::time_point _last_arrival{};
+    double _mean{0.0};
+    double _variance{0.0};
+
+    // Standard deviations of margin above the mean interval
+    double _margin{2.0};
+};
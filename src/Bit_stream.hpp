@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/// @brief Packs values of arbitrary bit width into a caller-provided buffer
+///
+/// Bits are written least significant first. Writing past the end of the
+/// buffer doesn't throw; it sets overflowed() and further writes are ignored, so
+/// a whole message can be written before checking once.
+class Bit_writer {
+    std::span<std::byte> _buffer;
+    std::size_t _bit{0};
+    bool _overflowed{false};
+
+public:
+    explicit Bit_writer(std::span<std::byte> buffer)
+      : _buffer(buffer)
+    {}
+
+    /// @pre bits <= 64 and value fits in bits
+    void write(uint64_t value, unsigned bits)
+    {
+        if (_overflowed || _bit + bits > _buffer.size() * 8) {
+            _overflowed = true;
+            return;
+        }
+
+        while (bits > 0) {
+            const auto byte_index = _bit / 8;
+            const auto bit_offset = static_cast<unsigned>(_bit % 8);
+            const unsigned chunk = std::min(bits, 8U - bit_offset);
+            const unsigned mask = (1U << chunk) - 1U;
+
+            auto byte = std::to_integer<unsigned>(_buffer[byte_index]);
+            byte &= ~(mask << bit_offset);
+            byte |= (static_cast<unsigned>(value) & mask) << bit_offset;
+            _buffer[byte_index] = static_cast<std::byte>(byte);
+
+            value >>= chunk;
+            bits -= chunk;
+            _bit += chunk;
+        }
+    }
+
+    void write_bool(bool value) { write(value ? 1U : 0U, 1); }
+
+    /// @brief Writes value in 7 bit groups, each followed by a continuation bit
+    ///
+    /// Small values, like ids and tick deltas, take a single byte.
+    void write_varint(uint64_t value)
+    {
+        do {
+            write(value & 0x7FU, 7);
+            value >>= 7U;
+            write_bool(value != 0);
+        } while (value != 0 && !_overflowed);
+    }
+
+    [[nodiscard]]
+    bool overflowed() const
+    {
+        return _overflowed;
+    }
+
+    /// @brief Bytes touched so far, the size of the message once done writing
+    [[nodiscard]]
+    std::size_t bytes_written() const
+    {
+        return (_bit + 7) / 8;
+    }
+};
+
+/// @brief Reads values written by Bit_writer
+///
+/// Reading past the end sets failed() and returns zeros, so a whole message can
+/// be read before checking once.
+class Bit_reader {
+    std::span<std::byte const> _buffer;
+    std::size_t _bit{0};
+    bool _failed{false};
+
+public:
+    explicit Bit_reader(std::span<std::byte const> buffer)
+      : _buffer(buffer)
+    {}
+
+    /// @pre bits <= 64
+    uint64_t read(unsigned bits)
+    {
+        if (_failed || _bit + bits > _buffer.size() * 8) {
+            _failed = true;
+            return 0;
+        }
+
+        uint64_t value{0};
+        unsigned shift{0};
+
+        while (bits > 0) {
+            const auto byte_index = _bit / 8;
+            const auto bit_offset = static_cast<unsigned>(_bit % 8);
+            const unsigned chunk = std::min(bits, 8U - bit_offset);
+            const unsigned mask = (1U << chunk) - 1U;
+
+            const auto byte = std::to_integer<unsigned>(_buffer[byte_index]);
+            value |= uint64_t{(byte >> bit_offset) & mask} << shift;
+
+            shift += chunk;
+            bits -= chunk;
+            _bit += chunk;
+        }
+
+        return value;
+    }
+
+    bool read_bool() { return read(1) != 0; }
+
+    uint64_t read_varint()
+    {
+        uint64_t value{0};
+
+        // 10 groups of 7 bits cover 64 bits, anything longer is corrupt
+        for (unsigned shift = 0; shift < 70 && !_failed; shift += 7) {
+            value |= read(7) << shift;
+            if (!read_bool()) {
+                return value;
+            }
+        }
+
+        _failed = true;
+        return 0;
+    }
+
+    [[nodiscard]]
+    bool failed() const
+    {
+        return _failed;
+    }
+};
@@ -1,141 +1,348 @@
 #include "Client.hpp"
 
-#include "Utils.hpp"
+#include "Trace.hpp"
 
 #include <spdlog/spdlog.h>
 
-void Client::send(const Server_update& update, std::chrono::milliseconds delay)
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// Corrections are recorded in 1/1024ths of a unit
+constexpr double correction_resolution{1024.0};
+
+}  // namespace
+
+Client::Client(std::size_t interpolation_capacity, Clock const& clock)
+  : _clock(&clock),
+    _interpolation(interpolation_capacity)
+{
+    register_metrics("client=\"none\"");
+}
+
+void Client::entity_id(size_t id)
+{
+    _entity_id = id;
+
+    // By slot, like Client_traffic, so clients coming and going reuse series
+    register_metrics(metrics::label("client", entity_index(id)));
+}
+
+void Client::register_metrics(const std::string& labels)
 {
-    const Delayed_server_update msg{
-      .message = update, .recv_timestamp = std::chrono::system_clock::now() + delay};
+    auto& registry = metrics::registry();
+
+    _updates_received = &registry.counter(
+      "netcode_client_updates_received_total",
+      "Server updates a client has reconstructed",
+      labels
+    );
+    _corrections = &registry.counter(
+      "netcode_client_corrections_total",
+      "Predictions the server disagreed with and that were corrected",
+      labels
+    );
+    _prediction_snaps = &registry.counter(
+      "netcode_client_prediction_snaps_total",
+      "Predictions the server disagreed with after the inputs to replay were "
+      "overwritten, corrected by snapping to the server's position",
+      labels
+    );
+    _interpolation_underruns = &registry.counter(
+      "netcode_client_interpolation_underruns_total",
+      "Frames without snapshots on both sides of the render time",
+      labels
+    );
+    _extrapolated_frames = &registry.counter(
+      "netcode_client_extrapolated_frames_total",
+      "Frames rendering remote entities past the newest snapshot",
+      labels
+    );
+    _interpolation_delay = &registry.gauge(
+      "netcode_client_interpolation_delay_seconds",
+      "How far in the past remote entities are rendered",
+      labels
+    );
 
-    {
-        const std::scoped_lock lock(_queue_mutex);
-        _queue.push_back(msg);
+    // Shared by every client in the process, histograms are too big to keep
+    // one per client
+    _correction_distance = &registry.histogram(
+      "netcode_client_correction_distance",
+      "How far corrections moved the predicted position",
+      1.0 / correction_resolution
+    );
+}
+
+void Client::send(const Server_update& update, std::chrono::microseconds delay)
+{
+    const auto recv_timestamp = _clock->now() + delay;
+
+    if (!_inbound.try_push(Arrival{update, recv_timestamp})) {
+        spdlog::warn("[client] [{}] inbound queue full, update dropped", _entity_id);
     }
 }
 
 void Client::process_server_messages()
 {
-    const std::scoped_lock lock(_queue_mutex);
+    // A single "now" decides what has arrived and timestamps the snapshots
+    // for interpolation. The adaptive delay measures network jitter, so it
+    // takes when each update actually arrived instead.
+    const auto now = _clock->now();
+
+    _inbound.drain([this](Arrival&& arrival) {
+        _queue.push(std::move(arrival.first), arrival.second);
+    });
 
-    for (const auto& msg : _queue) {
-        if (msg.recv_timestamp <= std::chrono::system_clock::now()) {
-            for (const auto& state : msg.message.states) {
-                spdlog::info(
-                  "[client] [{}] recv: (seq={}) (id={}, pos={:.3f})",
+    _due.clear();
+    _due_times.clear();
+    _queue.pop_due(now, _due, _due_times);
+
+    for (std::size_t i = 0; i < _due.size(); ++i) {
+        const auto& msg = _due[i];
+
+        // Anything older than what we already have would step interpolation
+        // backwards in time
+        if (msg.tick <= _latest_tick) {
+            continue;
+        }
+
+        const Snapshot* baseline{nullptr};
+        if (msg.baseline_tick != 0) {
+            // A baseline a full history back would share a slot with the
+            // snapshot being reconstructed
+            if (msg.tick - msg.baseline_tick < snapshot_history_size) {
+                baseline = _snapshots.find(msg.baseline_tick);
+            }
+
+            // The server only deltas against acknowledged snapshots, so this
+            // only happens if we have since fallen too far behind. A full
+            // snapshot follows once our acknowledgements are stale.
+            if (baseline == nullptr) {
+                spdlog::debug(
+                  "[client] [{}] missing baseline {} for tick {}",
                   _entity_id,
-                  msg.message.last_processed_input,
-                  state.id,
-                  state.position
+                  msg.baseline_tick,
+                  msg.tick
                 );
+                continue;
+            }
+        }
 
-                // If we haven't seen this entity before, allocate space for it
-                if (state.id + 1 > _entities.size()) {
-                    // Since we use indices to match entity ids, we need to resize
-                    // the vector to hold at least the (id + 1) so we can index
-                    // into that entity. Alternatively, we could preallocate
-                    // or use a different data structure like a flat map.
-                    _entities.resize(state.id + 1);
-                }
+        // Ids off the network can't be trusted to be sensible, and positions
+        // are indexed by them
+        if (std::ranges::any_of(msg.states, [](const Entity_state& state) {
+                return entity_index(state.id) >= max_entities;
+            })) {
+            spdlog::warn(
+              "[client] [{}] entity id out of range in tick {}",
+              _entity_id,
+              msg.tick
+            );
+            continue;
+        }
 
-                _entities[state.id].position = state.position;
+        auto& snapshot = _snapshots.store(msg.tick);
+        if (baseline != nullptr) {
+            patch(baseline->states(), msg.states, msg.removed, snapshot.owned);
+        }
+        else {
+            snapshot.owned.assign(msg.states.begin(), msg.states.end());
+        }
 
-                // If the entity is not this client's entity, save server update
-                // for interpolation
-                if (state.id != _entity_id) {
-                    const auto now = std::chrono::system_clock::now();
+        _latest_tick = msg.tick;
+        _ack_pending = true;
+        _adaptive_delay.arrival(_due_times[i]);
+        _updates_received->add();
 
-                    _entities[state.id].updates.emplace_back(state.position, now);
-                    continue;
-                }
+        if (_recorder != nullptr) {
+            _recorder->update_received(_entity_id, msg);
+        }
 
-                // TODO: Global config object / DI? Assuming rn that
-                //  this just never grows
+        trace::record<trace::Event::client_update>(
+          _entity_id, msg.tick, msg.baseline_tick, msg.last_processed_input
+        );
 
-                // Remove acknowledged messages
-                std::erase_if(
-                  _unacknowledged_messages,
-                  [msg](const Client_message& sent_msg) {
-                      return sent_msg.sequence_number <=
-                        msg.message.last_processed_input;
-                  }
-                );
+        for (const auto& state : snapshot.owned) {
+            trace::record<trace::Event::client_state>(
+              _entity_id, state.id, state.position
+            );
+
+            // Slots are reused, so positions only grow with the most entities
+            // alive at once
+            const auto index = entity_index(state.id);
+            if (index + 1 > _positions.size()) {
+                _positions.resize(index + 1);
+                _ids.resize(index + 1, no_entity);
+            }
+
+            // A new entity in the slot, don't blend from the one before it
+            if (_ids[index] != state.id) {
+                _ids[index] = state.id;
+                _interpolation.forget(state.id);
 
-                // Reapply unacknowledged messages
-                for (const Client_message& unack_msg : _unacknowledged_messages) {
-                    spdlog::debug(
-                      "[client] reapply: (seq={}, dur={:.3f})",
-                      unack_msg.sequence_number,
-                      unack_msg.duration.count()
-                    );
-                    offset(update_position(offset(), unack_msg.duration.count()));
+                if (index < _extrapolated.size()) {
+                    _extrapolated[index] = std::numeric_limits<double>::quiet_NaN();
+                }
+                if (index < _blend_offsets.size()) {
+                    _blend_offsets[index] = 0.0;
                 }
             }
+
+            // Other entities are interpolated from the snapshot pushed below
+            if (state.id != _entity_id) {
+                _positions[index] = state.position;
+                continue;
+            }
+
+            const auto predicted = _positions[index];
+            const auto replays = _reconciler.replays();
+            const auto snaps = _reconciler.snaps();
+
+            _positions[index] = _reconciler.reconcile(
+              msg.last_processed_input, state.position, predicted
+            );
+
+            if (_reconciler.snaps() != snaps) {
+                _prediction_snaps->add();
+            }
+            if (_reconciler.replays() != replays ||
+                _reconciler.snaps() != snaps) {
+                _corrections->add();
+                _correction_distance->record(static_cast<uint64_t>(std::llround(
+                  std::abs(_positions[index] - predicted) * correction_resolution
+                )));
+            }
         }
+
+        // Entities that left our area of interest are missing from this
+        // snapshot, so they aren't interpolated across the gap if they return
+        _interpolation.push(now, snapshot.owned, _entity_id);
     }
 
-    std::erase_if(_queue, [](const auto& msg) {
-        return msg.recv_timestamp <= std::chrono::system_clock::now();
-    });
+    if (_recorder != nullptr && !_due.empty()) {
+        _recorder->client_frame(_entity_id);
+    }
 }
 
-std::optional<std::pair<Entity::Update, Entity::Update>>
-Client::find_surrounding_updates(
-  const std::vector<Entity::Update>& updates,
-  std::chrono::time_point<std::chrono::system_clock, milliseconds_d> time
-) const
+void Client::interpolate_entities(
+  const milliseconds_d server_update_interval, const std::size_t delay_in_ticks
+)
 {
-    // TODO: Could be a small class, or a free function and pass in update container
-    if (updates.size() < 2) {
-        return std::nullopt;
+    const auto now = _clock->now();
+
+    // We want to render other entities in the past, by a fixed number of ticks
+    // or by as much as the jitter of their snapshots calls for
+    const auto fixed_delay = delay_in_ticks * server_update_interval;
+    const auto delay = _adaptive_delay.enabled()
+      ? _adaptive_delay.delay(fixed_delay)
+      : fixed_delay;
+    _interpolation_delay->set(std::chrono::duration<double>{delay}.count());
+
+    // An adaptive delay isn't a whole number of ticks, finding snapshots on
+    // both sides of the render time is all that can be asked for
+    const bool interpolated =
+      render(now - delay, _adaptive_delay.enabled() ? 1 : delay_in_ticks);
+
+    if (_adaptive_delay.enabled()) {
+        _adaptive_delay.frame(now, !interpolated);
+    }
+}
+
+bool Client::render(
+  Interpolation_buffer::render_time_point render_time, std::size_t delay_in_ticks
+)
+{
+    // Must have at least the number of ticks we want to delay rendering by + 1,
+    // so we have an update prior the render time that we could interpolate from.
+    // With extrapolation, any two around the render time will do: running out
+    // of them moves entities on from the newest rather than freezing them
+    // first, and the first snapshot after a late one is enough to interpolate
+    // towards.
+    std::optional<std::size_t> index;
+    if (_interpolation.size() > delay_in_ticks || _extrapolation.enabled()) {
+        index = _interpolation.bracket(render_time);
     }
 
-    for (std::size_t i = 0; i < updates.size() - 1; ++i) {
-        auto u0 = updates[i];
-        auto u1 = updates[i + 1];
+    if (index.has_value()) {
+        _interpolation.interpolate(*index, render_time, _positions);
 
-        if (u0.t <= time && time <= u1.t) {
-            return std::make_pair(u0, u1);
+        // Remove all snapshots that occurred before our "t0"
+        _interpolation.evict_before(*index);
+
+        if (_extrapolating) {
+            // Start from wherever the entities were extrapolated to, and drift
+            // onto the interpolated path from there
+            _extrapolating = false;
+            _blend_start = render_time;
+            _blend_offsets.resize(_positions.size(), 0.0);
+
+            const auto own = entity_index(_entity_id);
+            const auto count = std::min(_extrapolated.size(), _positions.size());
+            for (std::size_t i = 0; i < count; ++i) {
+                const double offset = _extrapolated[i] - _positions[i];
+                _blend_offsets[i] = std::isnan(offset) || i == own ? 0.0 : offset;
+            }
         }
+
+        blend(render_time);
+        return true;
+    }
+
+    // Snapshots are late: the render time has passed the newest one
+    if (!_extrapolation.enabled() || _interpolation.size() == 0 ||
+        render_time <= _interpolation.newest_time()) {
+        _interpolation_underruns->add();
+        return false;
     }
 
-    return std::nullopt;
+    _extrapolating = true;
+    _extrapolated_frames->add();
+
+    _interpolation.extrapolate(render_time, _extrapolation.limit, _positions);
+    blend(render_time);
+
+    // Only the newest snapshot is extrapolated from, or interpolated from once
+    // the next one arrives
+    _interpolation.evict_before(_interpolation.size() - 1);
+
+    _extrapolated.assign(_positions.begin(), _positions.end());
+    return false;
 }
 
-void Client::interpolate_entities(
-  const milliseconds_d server_update_interval, const std::size_t delay_in_ticks
-)
+void Client::blend(Interpolation_buffer::render_time_point render_time)
 {
-    const auto delay = delay_in_ticks * server_update_interval;
-
-    const auto now = std::chrono::system_clock::now();
-
-    // We want to render other entities in the past
-    const auto render_time = now - delay;
-
-    for (auto& entity : _entities) {
-        // Must have at least the number of ticks we want to delay rendering by + 1,
-        // so we have an update prior the render time that we could interpolate from.
-        if (entity.updates.size() > delay_in_ticks) {
-            std::optional<std::pair<Entity::Update, Entity::Update>>
-              surrounding_updates =
-                find_surrounding_updates(entity.updates, render_time);
-
-            if (surrounding_updates.has_value()) {
-                auto [u0, u1] = surrounding_updates.value();
-                entity.position =
-                  std::lerp(u0.x, u1.x, (render_time - u0.t) / (u1.t - u0.t));
-
-                // Remove all updates that occurred before our "t0"
-                std::erase_if(entity.updates, [u0](const Entity::Update& update) {
-                    return update.t < u0.t;
-                });
-            }
+    if (_blend_offsets.empty() || _extrapolation.blend.count() <= 0.0) {
+        return;
+    }
+
+    const double remaining =
+      1.0 - (render_time - _blend_start) / _extrapolation.blend;
+    if (remaining <= 0.0) {
+        return;
+    }
+
+    const auto own = entity_index(_entity_id);
+    const auto count = std::min(_blend_offsets.size(), _positions.size());
+    for (std::size_t i = 0; i < count; ++i) {
+        if (i != own) {
+            _positions[i] += _blend_offsets[i] * remaining;
         }
     }
 }
 
+std::optional<Client_ack> Client::acknowledgement()
+{
+    if (!_ack_pending) {
+        return std::nullopt;
+    }
+
+    _ack_pending = false;
+    return Client_ack{.entity_id = _entity_id, .tick = _latest_tick};
+}
+
 double Client::offset() const
 {
     // TODO: Hacky and just so we can query where the spectator thinks
@@ -144,23 +351,32 @@ double Client::offset() const
     //  spectator also implicitly has a player character that is never
     //  rendered.
 
-    if (_entities.empty()) {
+    if (_positions.empty()) {
         return 0.0;
     }
 
-    return _entities[0].position;
+    return _positions[0];
+}
+
+std::optional<double> Client::position(std::size_t id) const
+{
+    const auto index = entity_index(id);
+    if (index >= _ids.size() || _ids[index] != id) {
+        return std::nullopt;
+    }
+    return _positions[index];
 }
 
 void Client::offset(double offset)
 {
-    if (_entities.empty()) {
+    if (_positions.empty()) {
         return;
     }
 
-    _entities[0].position = offset;
+    _positions[0] = offset;
 }
 
 void Client::save(const Client_message& msg)
 {
-    _unacknowledged_messages.push_back(msg);
+    _reconciler.record(msg, offset());
 }
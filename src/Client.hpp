@@ -1,50 +1,188 @@
 #pragma once
 
+#include "Clock.hpp"
 #include "Command_message.hpp"
+#include "Adaptive_delay.hpp"
 #include "common.hpp"
-#include "Entity.hpp"
+#include "Delay_queue.hpp"
+#include "Entity_registry.hpp"
+#include "Interpolation_buffer.hpp"
+#include "Metrics.hpp"
+#include "Mpsc_queue.hpp"
+#include "Reconciler.hpp"
+#include "Recorder.hpp"
 #include "Server_update.hpp"
+#include "Snapshot.hpp"
 
-#include <mutex>
-#include <queue>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief Server updates that can be handed to a client between two calls to
+/// process_server_messages() before it starts dropping them
+constexpr std::size_t client_inbound_capacity{256};
+
+/// @brief How remote entities are rendered once the render time has passed the
+/// newest snapshot, because snapshots are running late
+///
+/// Rather than freezing, they move on along their last known velocity for up
+/// to limit, then stop. When interpolation picks up again, the gap between
+/// where they were extrapolated to and where they are interpolated is closed
+/// gradually over blend instead of at once.
+struct Extrapolation_config {
+    // 0 to freeze entities as soon as snapshots run late
+    milliseconds_d limit{0.0};
+    milliseconds_d blend{100.0};
+
+    [[nodiscard]]
+    bool enabled() const
+    {
+        return limit.count() > 0.0;
+    }
+};
 
 class Client {
-    struct Delayed_server_update {
-        Server_update message;
-        std::chrono::system_clock::time_point recv_timestamp;
-    };
+    Clock const* _clock;
+
+    // Handed over by send() on any thread, moved into _queue by
+    // process_server_messages()
+    using Arrival = std::pair<Server_update, Clock::time_point>;
+    Mpsc_queue<Arrival> _inbound{client_inbound_capacity};
+
+    // Updates held back until their network delay has passed
+    Delay_queue<Server_update> _queue;
+
+    // Updates popped from _queue and when each arrived, kept to reuse their
+    // capacity
+    std::vector<Server_update> _due;
+    std::vector<Clock::time_point> _due_times;
+
+    // Predicted inputs, replayed when the server disagrees with the prediction
+    Reconciler _reconciler;
+
+    size_t _entity_id{0};
+
+    // Rendered position of every entity, indexed by entity_index()
+    std::vector<double> _positions;
+
+    // Id of the entity each position belongs to, to tell when a slot has been
+    // reused by a new entity
+    std::vector<std::size_t> _ids;
+
+    // Snapshots of the remote entities, rendered in the past between two of them
+    Interpolation_buffer _interpolation;
+
+    Adaptive_delay _adaptive_delay;
+
+    Extrapolation_config _extrapolation;
+    bool _extrapolating{false};
+
+    // Positions rendered by the last extrapolated frame, indexed like
+    // _positions, NaN for slots reused since
+    std::vector<double> _extrapolated;
+
+    // How far each entity was off the interpolated path when interpolation
+    // picked up again, faded out over _extrapolation.blend from _blend_start
+    std::vector<double> _blend_offsets;
+    Interpolation_buffer::render_time_point _blend_start;
 
-    std::mutex _queue_mutex;
-    std::vector<Delayed_server_update> _queue;
+    // Reconstructed snapshots, the baselines the server's deltas refer to
+    Snapshot_history _snapshots;
+    uint32_t _latest_tick{0};
+    bool _ack_pending{false};
 
-    std::vector<Client_message> _unacknowledged_messages;
+    // Live metrics, registered again under the entity's slot once it is assigned
+    metrics::Counter* _updates_received{nullptr};
+    metrics::Counter* _corrections{nullptr};
+    metrics::Counter* _prediction_snaps{nullptr};
+    metrics::Counter* _interpolation_underruns{nullptr};
+    metrics::Counter* _extrapolated_frames{nullptr};
+    metrics::Gauge* _interpolation_delay{nullptr};
+    metrics::Histogram* _correction_distance{nullptr};
 
-    size_t _entity_id;
+    void register_metrics(std::string const& labels);
 
-    std::vector<Entity> _entities;
+    /// @brief Renders remote entities as of render_time
+    /// @return false if there were no snapshots on both sides of it
+    bool render(
+      Interpolation_buffer::render_time_point render_time,
+      std::size_t delay_in_ticks
+    );
+
+    /// @brief Adds what is left of the blend offsets to the remote positions
+    void blend(Interpolation_buffer::render_time_point render_time);
+
+    Recorder* _recorder{nullptr};
 
 public:
+    /// @param interpolation_capacity Snapshots of remote entities to keep for
+    ///  interpolation, at most
+    /// @param clock What update delays and render times are measured against,
+    ///  must outlive the client
+    explicit Client(
+      std::size_t interpolation_capacity = default_interpolation_capacity,
+      Clock const& clock = real_clock()
+    );
+
+    [[nodiscard]]
+    Clock const& clock() const
+    {
+        return *_clock;
+    }
+
     void offset(double);
 
     [[nodiscard]]
     double offset() const;
 
+    /// @brief Where the entity is rendered as of the last frame
+    /// @return nullopt if no update has mentioned it, or its slot has since
+    ///  been reused
+    [[nodiscard]]
+    std::optional<double> position(std::size_t id) const;
+
     size_t entity_id() const { return _entity_id; }
 
-    void entity_id(size_t id) { _entity_id = id; }
+    void entity_id(size_t id);
+
+    /// @brief Records the updates reconstructed and when they were processed,
+    /// until set back to nullptr
+    void recorder(Recorder* recorder) { _recorder = recorder; }
+
+    /// @brief Tunes the interpolation delay to the jitter of the updates
+    /// received, rather than keeping the one interpolate_entities() is given
+    void adaptive_delay(Adaptive_delay_config const& config)
+    {
+        _adaptive_delay = Adaptive_delay(config);
+    }
+
+    /// @brief Extrapolates remote entities when snapshots run late, instead of
+    /// freezing them
+    void extrapolation(Extrapolation_config const& config)
+    {
+        _extrapolation = config;
+    }
 
     void process_server_messages();
-    void send(Server_update const& update, std::chrono::milliseconds delay);
+
+    /// @brief The newest reconstructed snapshot, once per snapshot
+    /// @return nullopt if nothing new has been reconstructed since the last call
+    [[nodiscard]]
+    std::optional<Client_ack> acknowledgement();
+
+    /// @brief Queues a server update for processing once delay has passed. Safe
+    /// to call from any thread, and never blocks.
+    void send(Server_update const& update, std::chrono::microseconds delay);
+    /// @brief Records a predicted input for reconciliation, call after applying
+    /// it to offset()
     void save(Client_message const& msg);
+    /// @brief Renders remote entities delay_in_ticks server updates in the past
+    ///
+    /// With adaptive_delay() enabled, delay_in_ticks is only where the delay
+    /// starts out.
     void interpolate_entities(
       milliseconds_d server_update_interval, std::size_t delay_in_ticks
     );
-
-private:
-    [[nodiscard]]
-    std::optional<std::pair<Entity::Update, Entity::Update>>
-    find_surrounding_updates(
-      const std::vector<Entity::Update>& updates,
-      std::chrono::time_point<std::chrono::system_clock, milliseconds_d> time
-    ) const;
 };
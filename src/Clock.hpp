@@ -0,0 +1,75 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/// @brief Where Server and Client read the time from
+///
+/// Every delay, arrival and render time is measured against one of these, so
+/// a headless simulation can swap real time for a Virtual_clock and run as
+/// many ticks per second as the CPU allows, the same way every run.
+class Clock {
+public:
+    using duration = std::chrono::steady_clock::duration;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    Clock() = default;
+    virtual ~Clock() = default;
+
+    DISABLE_COPY(Clock);
+    DISABLE_MOVE(Clock);
+
+    /// @brief Never goes backwards. Safe to call from any thread.
+    [[nodiscard]]
+    virtual time_point now() const = 0;
+};
+
+/// @brief The monotonic time of the machine
+class Real_clock final : public Clock {
+public:
+    [[nodiscard]]
+    time_point now() const override
+    {
+        return std::chrono::steady_clock::now();
+    }
+};
+
+/// @brief The clock Server and Client use unless given another, shared by the
+/// whole process
+inline Clock const& real_clock()
+{
+    static const Real_clock clock;
+    return clock;
+}
+
+/// @brief Time that only moves when told to
+///
+/// Starts at the epoch of steady_clock. Whoever drives the simulation advances
+/// it, typically by one tick interval per tick; other threads may read it
+/// meanwhile.
+class Virtual_clock final : public Clock {
+public:
+    [[nodiscard]]
+    time_point now() const override
+    {
+        return time_point{duration{_now.load(std::memory_order_acquire)}};
+    }
+
+    /// @pre by >= 0
+    void advance(duration by)
+    {
+        _now.fetch_add(by.count(), std::memory_order_acq_rel);
+    }
+
+    /// @pre time is no earlier than now()
+    void set(time_point time)
+    {
+        _now.store(time.time_since_epoch().count(), std::memory_order_release);
+    }
+
+private:
+    std::atomic<duration::rep> _now{0};
+};
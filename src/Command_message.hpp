@@ -1,9 +1,39 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 
 struct Client_message {
     std::size_t entity_id;
     std::chrono::duration<double> duration;
     uint32_t sequence_number;
 };
+
+// Most inputs a single Input_batch carries
+constexpr std::size_t max_batched_inputs{8};
+
+// A client's newest inputs, sent as one message per network tick. The inputs
+// have consecutive sequence numbers ending at last_sequence_number, oldest
+// first. Each is repeated in the batches that follow until newer ones push it
+// out, so the server can recover a lost batch from the next one.
+struct Input_batch {
+    std::size_t entity_id;
+    uint32_t last_sequence_number;
+    uint32_t count;
+    std::array<std::chrono::duration<double>, max_batched_inputs> durations;
+
+    [[nodiscard]]
+    uint32_t first_sequence_number() const
+    {
+        return last_sequence_number - count + 1;
+    }
+};
+
+// Tells the server the newest snapshot a client has reconstructed, so later
+// updates can be sent as deltas against it
+struct Client_ack {
+    std::size_t entity_id;
+    uint32_t tick;
+};
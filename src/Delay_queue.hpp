@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// @brief Holds messages back until their delivery time, releasing the earliest
+/// first
+///
+/// A binary min-heap keyed by delivery time, so draining only touches the
+/// messages that are due: O(due * log n) instead of a scan over everything in
+/// flight. Messages with equal delivery times come out in the order they were
+/// pushed.
+///
+/// Not thread-safe; owners feed it from a single thread, see Mpsc_queue.
+template <typename T, typename Clock = std::chrono::steady_clock>
+class Delay_queue {
+public:
+    using time_point = typename Clock::time_point;
+
+    void push(T value, time_point due)
+    {
+        _heap.push_back(
+          Entry{.due = due, .order = _next_order++, .value = std::move(value)}
+        );
+        std::push_heap(_heap.begin(), _heap.end(), later);
+    }
+
+    /// @brief Moves every message due at or before now to the back of out,
+    /// earliest first
+    /// @return the number of messages moved
+    std::size_t pop_due(time_point now, std::vector<T>& out)
+    {
+        std::size_t count{0};
+
+        while (!_heap.empty() && _heap.front().due <= now) {
+            std::pop_heap(_heap.begin(), _heap.end(), later);
+            out.push_back(std::move(_heap.back().value));
+            _heap.pop_back();
+            ++count;
+        }
+
+        return count;
+    }
+
+    /// @brief Like pop_due(), also appending when each message was due to
+    /// due_times, for owners that care when it arrived rather than when it
+    /// was noticed
+    std::size_t pop_due(
+      time_point now, std::vector<T>& out, std::vector<time_point>& due_times
+    )
+    {
+        std::size_t count{0};
+
+        while (!_heap.empty() && _heap.front().due <= now) {
+            std::pop_heap(_heap.begin(), _heap.end(), later);
+            out.push_back(std::move(_heap.back().value));
+            due_times.push_back(_heap.back().due);
+            _heap.pop_back();
+            ++count;
+        }
+
+        return count;
+    }
+
+    [[nodiscard]]
+    bool empty() const
+    {
+        return _heap.empty();
+    }
+
+    [[nodiscard]]
+    std::size_t size() const
+    {
+        return _heap.size();
+    }
+
+    /// @brief Delivery time of the earliest message, the queue must not be empty
+    [[nodiscard]]
+    time_point next_due() const
+    {
+        return _heap.front().due;
+    }
+
+private:
+    struct Entry {
+        time_point due;
+        uint64_t order;
+        T value;
+    };
+
+    // std heap functions build a max-heap, so "less" means "delivered later"
+    static bool later(const Entry& lhs, const Entry& rhs)
+    {
+        if (lhs.due != rhs.due) {
+            return lhs.due > rhs.due;
+        }
+        return lhs.order > rhs.order;
+    }
+
+    std::vector<Entry> _heap;
+    uint64_t _next_order{0};
+};
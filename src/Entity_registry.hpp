@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/// @brief Entity ids pack the slot an entity lives in, in their low 32 bits,
+/// with how many times that slot had been reused when it spawned
+///
+/// Slot indices stay as dense as the live entities, so anything indexed by
+/// entity_index() is proportional to them. The generation tells an entity from
+/// an earlier one that lived in the same slot.
+[[nodiscard]]
+constexpr std::size_t entity_index(std::size_t id)
+{
+    return id & 0xFFFF'FFFFU;
+}
+
+[[nodiscard]]
+constexpr uint32_t entity_generation(std::size_t id)
+{
+    return static_cast<uint32_t>(id >> 32U);
+}
+
+[[nodiscard]]
+constexpr std::size_t make_entity_id(uint32_t index, uint32_t generation)
+{
+    return (std::size_t{generation} << 32U) | index;
+}
+
+/// @brief Orders ids by slot, then generation, which is the order "sorted by
+/// id" means throughout
+///
+/// Live entities never share a slot, so consecutive ones in a sorted update are
+/// a small slot gap apart however often their slots were reused, and that gap
+/// is what goes on the wire.
+[[nodiscard]]
+constexpr bool entity_before(std::size_t lhs, std::size_t rhs)
+{
+    if (entity_index(lhs) != entity_index(rhs)) {
+        return entity_index(lhs) < entity_index(rhs);
+    }
+    return entity_generation(lhs) < entity_generation(rhs);
+}
+
+/// @brief Entities alive at once at most, so a lookup table indexed by
+/// entity_index() never holds more than this many elements, whatever id comes
+/// off the network
+inline constexpr std::size_t max_entities{std::size_t{1} << 20U};
+
+/// @brief Never a valid entity id
+inline constexpr std::size_t no_entity{std::numeric_limits<std::size_t>::max()};
+
+/// @brief Generational slot map from entity ids to values of T
+///
+/// Values are stored densely, next to their ids, for iteration. A sparse array
+/// of slots, indexed by entity_index(), points into it, so spawning,
+/// despawning and looking up are O(1). Ids of despawned entities are stale:
+/// their slot's generation has moved on, and find() returns nullptr for them.
+///
+/// Freed slots are reused oldest first, keeping both arrays as large as the
+/// most entities ever alive at once rather than growing with churn.
+///
+/// Despawned entries are left in the dense array as holes, with an id of
+/// no_entity, and spawned ones appended to it, until compact() closes the
+/// holes and restores id order in one pass.
+///
+/// Not thread-safe, though values may be modified concurrently through find()
+/// as long as no two threads touch the same entity.
+template <typename T>
+class Entity_registry {
+public:
+    struct Entry {
+        std::size_t id;
+        T value;
+    };
+
+    /// @brief Adds an entity holding value
+    /// @return its id
+    /// @throws std::length_error if max_entities are already alive
+    std::size_t spawn(T value)
+    {
+        if (_size == max_entities) {
+            throw std::length_error("entity registry is full");
+        }
+
+        uint32_t index{0};
+        if (_free_head != no_slot) {
+            index = _free_head;
+            _free_head = _slots[index].next_free;
+            if (_free_head == no_slot) {
+                _free_tail = no_slot;
+            }
+        }
+        else {
+            index = static_cast<uint32_t>(_slots.size());
+            _slots.push_back(Slot{});
+        }
+
+        auto& slot = _slots[index];
+        const auto id = make_entity_id(index, slot.generation);
+
+        slot.alive = true;
+        slot.dense = _entries.size();
+
+        // A reused slot's id can sort before entries already there
+        if (!_entries.empty() && entity_before(id, _entries.back().id)) {
+            _sorted = false;
+        }
+
+        _entries.push_back(Entry{.id = id, .value = std::move(value)});
+        ++_size;
+
+        return id;
+    }
+
+    /// @brief Removes the entity, making id stale
+    /// @return false if it already was
+    bool despawn(std::size_t id)
+    {
+        if (!contains(id)) {
+            return false;
+        }
+
+        const auto index = static_cast<uint32_t>(entity_index(id));
+        auto& slot = _slots[index];
+
+        _entries[slot.dense].id = no_entity;
+        ++_holes;
+        --_size;
+
+        slot.alive = false;
+
+        // A slot whose generation would wrap is retired instead, so its ids
+        // are never handed out twice
+        if (++slot.generation == std::numeric_limits<uint32_t>::max()) {
+            return true;
+        }
+
+        slot.next_free = no_slot;
+        if (_free_tail != no_slot) {
+            _slots[_free_tail].next_free = index;
+        }
+        else {
+            _free_head = index;
+        }
+        _free_tail = index;
+
+        return true;
+    }
+
+    [[nodiscard]]
+    bool contains(std::size_t id) const
+    {
+        const auto index = entity_index(id);
+        return index < _slots.size() && _slots[index].alive &&
+          _slots[index].generation == entity_generation(id);
+    }
+
+    /// @return nullptr if id is stale or was never spawned
+    [[nodiscard]]
+    T* find(std::size_t id)
+    {
+        return contains(id) ? &_entries[_slots[entity_index(id)].dense].value
+                            : nullptr;
+    }
+
+    [[nodiscard]]
+    T const* find(std::size_t id) const
+    {
+        return contains(id) ? &_entries[_slots[entity_index(id)].dense].value
+                            : nullptr;
+    }
+
+    /// @pre contains(id)
+    [[nodiscard]]
+    T& get(std::size_t id)
+    {
+        return _entries[_slots[entity_index(id)].dense].value;
+    }
+
+    /// @pre contains(id)
+    [[nodiscard]]
+    T const& get(std::size_t id) const
+    {
+        return _entries[_slots[entity_index(id)].dense].value;
+    }
+
+    /// @brief Closes the holes left by despawned entities and sorts entries by
+    /// id
+    ///
+    /// O(n) plus sorting what was spawned into reused slots since the last
+    /// call, and free if nothing was despawned or reused.
+    void compact()
+    {
+        if (_holes == 0 && _sorted) {
+            return;
+        }
+
+        const auto is_hole = [](const Entry& entry) {
+            return entry.id == no_entity;
+        };
+        std::erase_if(_entries, is_hole);
+        _holes = 0;
+
+        if (!_sorted) {
+            // Entries before the first one out of order are still sorted, the
+            // rest were appended since and are few
+            const auto by_id = [](const Entry& lhs, const Entry& rhs) {
+                return entity_before(lhs.id, rhs.id);
+            };
+            const auto tail = std::is_sorted_until(
+              _entries.begin(), _entries.end(), by_id
+            );
+            std::sort(tail, _entries.end(), by_id);
+            std::inplace_merge(_entries.begin(), tail, _entries.end(), by_id);
+            _sorted = true;
+        }
+
+        for (std::size_t i = 0; i < _entries.size(); ++i) {
+            _slots[entity_index(_entries[i].id)].dense = i;
+        }
+    }
+
+    /// @brief Every entity in id order, once compact() has run since the last
+    /// spawn or despawn
+    [[nodiscard]]
+    std::span<Entry> entries()
+    {
+        return _entries;
+    }
+
+    [[nodiscard]]
+    std::span<Entry const> entries() const
+    {
+        return _entries;
+    }
+
+    /// @brief Live entities
+    [[nodiscard]]
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    [[nodiscard]]
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    /// @brief Slots ever allocated, the most entities that were alive at once
+    [[nodiscard]]
+    std::size_t slot_count() const
+    {
+        return _slots.size();
+    }
+
+private:
+    static constexpr uint32_t no_slot{std::numeric_limits<uint32_t>::max()};
+
+    struct Slot {
+        // Of the entity in the slot, or of the next one to spawn in it
+        uint32_t generation{0};
+
+        // Next slot in the free list while free
+        uint32_t next_free{no_slot};
+
+        // Index of the entity's entry while alive
+        std::size_t dense{0};
+
+        bool alive{false};
+    };
+
+    std::vector<Slot> _slots;
+    std::vector<Entry> _entries;
+
+    // Oldest and newest freed slots
+    uint32_t _free_head{no_slot};
+    uint32_t _free_tail{no_slot};
+
+    std::size_t _size{0};
+    std::size_t _holes{0};
+    bool _sorted{true};
+};
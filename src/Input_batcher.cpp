@@ -0,0 +1,38 @@
+#include "Input_batcher.hpp"
+
+#include <algorithm>
+
+Input_batcher::Input_batcher(uint32_t redundancy)
+  : _redundancy(redundancy)
+{}
+
+void Input_batcher::add(const Client_message& msg)
+{
+    // A batch only describes consecutive inputs, start over after a gap
+    if (_batch.count != 0 &&
+        msg.sequence_number != _batch.last_sequence_number + 1) {
+        _batch.count = 0;
+    }
+
+    if (_batch.count == max_batched_inputs) {
+        std::shift_left(_batch.durations.begin(), _batch.durations.end(), 1);
+        --_batch.count;
+    }
+
+    _batch.entity_id = msg.entity_id;
+    _batch.durations[_batch.count] = msg.duration;
+    ++_batch.count;
+    _batch.last_sequence_number = msg.sequence_number;
+
+    _sends_left = _redundancy;
+}
+
+std::optional<Input_batch> Input_batcher::take()
+{
+    if (_sends_left == 0) {
+        return std::nullopt;
+    }
+
+    --_sends_left;
+    return _batch;
+}
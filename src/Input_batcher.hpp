@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Command_message.hpp"
+
+#include <cstdint>
+#include <optional>
+
+/// @brief Network ticks an input batch keeps being sent after its newest input,
+/// unless configured otherwise
+constexpr uint32_t default_input_redundancy{3};
+
+/// @brief Collects a client's inputs into one Input_batch per network tick
+///
+/// Batches hold the newest max_batched_inputs inputs, including ones already
+/// sent, and keep being sent for a few network ticks after the newest input.
+/// A lost batch is then covered by a later one without the server having to
+/// ask for anything again.
+class Input_batcher {
+    Input_batch _batch{};
+    uint32_t _redundancy;
+    uint32_t _sends_left{0};
+
+public:
+    explicit Input_batcher(uint32_t redundancy = default_input_redundancy);
+
+    void add(Client_message const& msg);
+
+    /// @brief The batch to send this network tick
+    /// @return nullopt once the newest input has been sent redundancy times
+    [[nodiscard]]
+    std::optional<Input_batch> take();
+};
@@ -0,0 +1,57 @@
+#include "Interest.hpp"
+
+#include "Entity_registry.hpp"
+
+#include <algorithm>
+
+void Spatial_index::rebuild(std::span<const Entity_state> states)
+{
+    _entries.resize(states.size());
+
+    for (std::size_t i = 0; i < states.size(); ++i) {
+        _entries[i] = Entry{.position = states[i].position, .index = i};
+    }
+
+    std::sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) {
+        return a.position < b.position;
+    });
+}
+
+void select_relevant(
+  const Spatial_index& index,
+  std::span<const Entity_state> states,
+  double center,
+  const Interest_config& config,
+  std::span<const Entity_state> previous,
+  std::vector<Entity_state>& out
+)
+{
+    out.clear();
+
+    const auto was_relevant = [previous](std::size_t id) {
+        const auto it = std::lower_bound(
+          previous.begin(),
+          previous.end(),
+          id,
+          [](const Entity_state& state, std::size_t value) {
+              return entity_before(state.id, value);
+          }
+        );
+        return it != previous.end() && it->id == id;
+    };
+
+    index.for_each_within(
+      center, config.radius + config.hysteresis, [&](std::size_t i) {
+          const auto& state = states[i];
+
+          if (std::abs(state.position - center) <= config.radius ||
+              was_relevant(state.id)) {
+              out.push_back(state);
+          }
+      }
+    );
+
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+        return entity_before(a.id, b.id);
+    });
+}
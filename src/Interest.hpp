@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Server_update.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <vector>
+
+/// @brief How far from its own entity a client is told about other entities
+///
+/// An entity becomes relevant once it is within radius and stays relevant
+/// until it is further than radius + hysteresis, so entities hovering around
+/// the boundary don't flicker in and out.
+struct Interest_config {
+    double radius{std::numeric_limits<double>::infinity()};
+    double hysteresis{0.0};
+
+    [[nodiscard]]
+    bool enabled() const
+    {
+        return std::isfinite(radius);
+    }
+};
+
+/// @brief Entities sorted by position, for range queries
+///
+/// The world is one-dimensional, so a sorted sweep answers a radius query
+/// with two binary searches and a walk over the result.
+class Spatial_index {
+    struct Entry {
+        double position;
+        std::size_t index;
+    };
+
+    std::vector<Entry> _entries;
+
+public:
+    /// @brief Re-indexes states, indices passed to queries refer to it
+    void rebuild(std::span<Entity_state const> states);
+
+    /// @brief Calls fn(index) for every entity within radius of center
+    template <typename F>
+    void for_each_within(double center, double radius, F&& fn) const
+    {
+        auto it = std::lower_bound(
+          _entries.begin(),
+          _entries.end(),
+          center - radius,
+          [](const Entry& entry, double position) {
+              return entry.position < position;
+          }
+        );
+
+        for (; it != _entries.end() && it->position <= center + radius; ++it) {
+            fn(it->index);
+        }
+    }
+};
+
+/// @brief Writes the states relevant to a client whose entity is at center
+/// into out, sorted by id
+/// @param previous what the client was last sent, sorted by id; entities in it
+///   stay relevant out to radius + hysteresis
+void select_relevant(
+  Spatial_index const& index,
+  std::span<Entity_state const> states,
+  double center,
+  Interest_config const& config,
+  std::span<Entity_state const> previous,
+  std::vector<Entity_state>& out
+);
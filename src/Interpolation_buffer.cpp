@@ -0,0 +1,269 @@
+#include "Interpolation_buffer.hpp"
+
+#include "Entity_registry.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr double missing{std::numeric_limits<double>::quiet_NaN()};
+
+constexpr uint32_t no_column{std::numeric_limits<uint32_t>::max()};
+
+}  // namespace
+
+void interpolate_positions(
+  std::span<const double> from,
+  std::span<const double> to,
+  double alpha,
+  std::span<double> out
+)
+{
+    const std::size_t count = out.size();
+    std::size_t i{0};
+
+#if defined(__AVX__)
+    const __m256d alpha_v = _mm256_set1_pd(alpha);
+    for (; i + 4 <= count; i += 4) {
+        const __m256d x0 = _mm256_loadu_pd(&from[i]);
+        const __m256d x1 = _mm256_loadu_pd(&to[i]);
+        const __m256d x =
+          _mm256_add_pd(x0, _mm256_mul_pd(alpha_v, _mm256_sub_pd(x1, x0)));
+        _mm256_storeu_pd(&out[i], x);
+    }
+#elif defined(__SSE2__)
+    const __m128d alpha_v = _mm_set1_pd(alpha);
+    for (; i + 2 <= count; i += 2) {
+        const __m128d x0 = _mm_loadu_pd(&from[i]);
+        const __m128d x1 = _mm_loadu_pd(&to[i]);
+        const __m128d x = _mm_add_pd(x0, _mm_mul_pd(alpha_v, _mm_sub_pd(x1, x0)));
+        _mm_storeu_pd(&out[i], x);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        out[i] = from[i] + alpha * (to[i] - from[i]);
+    }
+}
+
+Interpolation_buffer::Interpolation_buffer(std::size_t capacity)
+  : _times(capacity)
+{}
+
+void Interpolation_buffer::push(
+  time_point time, std::span<const Entity_state> states, std::size_t skip
+)
+{
+    if (_size == capacity()) {
+        evict_before(1);
+    }
+
+    // Entities in none of the snapshots left give their columns back, which
+    // are missing from every row held already
+    for (uint32_t c = 0; c < _column_ids.size(); ++c) {
+        if (_column_ids[c] != no_entity && _last_pushes[c] + _size <= _pushes) {
+            _columns[entity_index(_column_ids[c])] = no_column;
+            _column_ids[c] = no_entity;
+            _free_columns.push_back(c);
+        }
+    }
+
+    ++_pushes;
+    for (const auto& state : states) {
+        if (state.id != skip) {
+            _last_pushes[column(state.id)] = _pushes;
+        }
+    }
+
+    if (_column_ids.size() > _stride) {
+        widen(_column_ids.size());
+    }
+
+    const std::size_t index = slot(_size);
+    ++_size;
+
+    _times[index] = time;
+
+    const auto positions =
+      std::span(_positions).subspan(index * _stride, _stride);
+    const auto velocities =
+      std::span(_velocities).subspan(index * _stride, _stride);
+    std::ranges::fill(positions, missing);
+    for (const auto& state : states) {
+        if (state.id != skip) {
+            const auto c = _columns[entity_index(state.id)];
+            positions[c] = state.position;
+            velocities[c] = state.velocity;
+        }
+    }
+}
+
+std::optional<std::size_t>
+Interpolation_buffer::bracket(render_time_point time) const
+{
+    // First snapshot at or after time
+    std::size_t low{0};
+    std::size_t high{_size};
+    while (low < high) {
+        const std::size_t middle = low + (high - low) / 2;
+        if (_times[slot(middle)] < time) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    if (low == 0 || low == _size) {
+        return std::nullopt;
+    }
+
+    return low - 1;
+}
+
+void Interpolation_buffer::interpolate(
+  std::size_t index, render_time_point time, std::span<double> out
+)
+{
+    const auto t0 = _times[slot(index)];
+    const auto t1 = _times[slot(index + 1)];
+
+    // Snapshots processed in the same frame share an arrival time
+    const double alpha = t1 > t0 ? (time - t0) / (t1 - t0) : 1.0;
+
+    const std::size_t count = _column_ids.size();
+    _scratch.resize(count);
+    interpolate_positions(row(index), row(index + 1), alpha, _scratch);
+
+    // Free columns are missing from both rows, so never scattered
+    for (std::size_t c = 0; c < count; ++c) {
+        const auto i = entity_index(_column_ids[c]);
+        if (!std::isnan(_scratch[c]) && i < out.size()) {
+            out[i] = _scratch[c];
+        }
+    }
+}
+
+void Interpolation_buffer::extrapolate(
+  render_time_point time, milliseconds_d limit, std::span<double> out
+) const
+{
+    const auto newest = _size - 1;
+    const milliseconds_d elapsed = time - _times[slot(newest)];
+    const double seconds =
+      std::chrono::duration<double>{std::min(elapsed, limit)}.count();
+
+    const auto positions = row(newest);
+    const auto velocities = velocity_row(newest);
+
+    // Missing entities are NaN and keep their current value, like interpolation
+    for (std::size_t c = 0; c < _column_ids.size(); ++c) {
+        const double x = positions[c] + velocities[c] * seconds;
+        const auto i = entity_index(_column_ids[c]);
+        if (!std::isnan(x) && i < out.size()) {
+            out[i] = x;
+        }
+    }
+}
+
+void Interpolation_buffer::evict_before(std::size_t index)
+{
+    index = std::min(index, _size);
+    _head = slot(index);
+    _size -= index;
+}
+
+void Interpolation_buffer::forget(std::size_t entity_id)
+{
+    const auto index = entity_index(entity_id);
+    if (index < _columns.size() && _columns[index] != no_column) {
+        release(_columns[index]);
+    }
+}
+
+std::span<const double> Interpolation_buffer::row(std::size_t index) const
+{
+    return std::span(_positions).subspan(slot(index) * _stride, _stride);
+}
+
+std::span<const double>
+Interpolation_buffer::velocity_row(std::size_t index) const
+{
+    return std::span(_velocities).subspan(slot(index) * _stride, _stride);
+}
+
+uint32_t Interpolation_buffer::column(std::size_t entity_id)
+{
+    const auto index = entity_index(entity_id);
+    if (index >= _columns.size()) {
+        _columns.resize(index + 1, no_column);
+    }
+
+    auto& c = _columns[index];
+
+    // A new entity in the slot, the old one's positions aren't its own
+    if (c != no_column && _column_ids[c] != entity_id) {
+        release(c);
+    }
+
+    if (c == no_column) {
+        if (_free_columns.empty()) {
+            c = static_cast<uint32_t>(_column_ids.size());
+            _column_ids.push_back(entity_id);
+            _last_pushes.push_back(0);
+        }
+        else {
+            c = _free_columns.back();
+            _free_columns.pop_back();
+            _column_ids[c] = entity_id;
+        }
+    }
+
+    return c;
+}
+
+void Interpolation_buffer::release(uint32_t column)
+{
+    // Rows beyond the column count were never written, so those are all
+    // missing already
+    if (column < _stride) {
+        for (std::size_t slot_index = 0; slot_index < capacity(); ++slot_index) {
+            _positions[slot_index * _stride + column] = missing;
+        }
+    }
+
+    _columns[entity_index(_column_ids[column])] = no_column;
+    _column_ids[column] = no_entity;
+    _free_columns.push_back(column);
+}
+
+void Interpolation_buffer::widen(std::size_t columns)
+{
+    // Grow geometrically, every row has to be copied each time
+    const std::size_t stride = std::max(columns, _stride * 2);
+
+    std::vector<double> positions(capacity() * stride, missing);
+    std::vector<double> velocities(capacity() * stride, 0.0);
+    for (std::size_t slot_index = 0; slot_index < capacity(); ++slot_index) {
+        const auto offset = static_cast<std::ptrdiff_t>(slot_index * stride);
+        std::ranges::copy(
+          std::span(_positions).subspan(slot_index * _stride, _stride),
+          positions.begin() + offset
+        );
+        std::ranges::copy(
+          std::span(_velocities).subspan(slot_index * _stride, _stride),
+          velocities.begin() + offset
+        );
+    }
+
+    _positions = std::move(positions);
+    _velocities = std::move(velocities);
+    _stride = stride;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Clock.hpp"
+#include "common.hpp"
+#include "Server_update.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+/// @brief Writes from + alpha * (to - from) to out, for every entity at once
+///
+/// Entities missing from either snapshot are NaN there, and so in out.
+/// Vectorized with AVX or SSE2 when the build targets them.
+/// @pre from and to hold at least out.size() positions
+void interpolate_positions(
+  std::span<const double> from,
+  std::span<const double> to,
+  double alpha,
+  std::span<double> out
+);
+
+/// @brief Snapshots kept for interpolation unless configured otherwise, about a
+/// second of updates at 60 Hz
+constexpr std::size_t default_interpolation_capacity{64};
+
+/// @brief Remote entity positions of recent snapshots, for interpolation
+///
+/// Stored as a structure of arrays: the arrival time of every snapshot, and one
+/// contiguous row of positions per snapshot, with a matching row of velocities.
+/// Rendering then interpolates between two rows in a single pass over all
+/// entities, or extrapolates from the newest one.
+///
+/// Each entity gets a column of the rows while it is in any snapshot held, and
+/// the column is handed to another entity once it isn't. Rows are only as wide
+/// as the most entities held at once, however sparse their ids are, and form a
+/// ring of fixed capacity, so each entity costs capacity positions regardless
+/// of how many snapshots pile up while nothing is rendered.
+class Interpolation_buffer {
+public:
+    using time_point = Clock::time_point;
+    using render_time_point =
+      std::chrono::time_point<time_point::clock, milliseconds_d>;
+
+    /// @pre capacity >= 2
+    explicit Interpolation_buffer(
+      std::size_t capacity = default_interpolation_capacity
+    );
+
+    /// @brief Appends a snapshot that arrived at time, dropping the oldest one
+    /// if full
+    ///
+    /// Entities not in states are stored as missing, as is skip, the client's
+    /// own entity, which is predicted rather than interpolated.
+    /// @pre time is no earlier than that of the last snapshot pushed
+    void push(
+      time_point time, std::span<const Entity_state> states, std::size_t skip
+    );
+
+    /// @brief Number of snapshots held
+    [[nodiscard]]
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    [[nodiscard]]
+    std::size_t capacity() const
+    {
+        return _times.size();
+    }
+
+    /// @brief The snapshot before time, if one at or after it is also held
+    ///
+    /// Binary search, the cost doesn't depend on how many snapshots are held.
+    /// @return Index of the first of the two snapshots, nullopt if time isn't
+    ///  between any two of them
+    [[nodiscard]]
+    std::optional<std::size_t> bracket(render_time_point time) const;
+
+    /// @brief Interpolates every entity between snapshots index and index + 1
+    /// @pre index + 1 < size()
+    /// @param out positions indexed by entity_index(), entities beyond its end
+    ///  are skipped
+    void interpolate(
+      std::size_t index, render_time_point time, std::span<double> out
+    );
+
+    /// @brief Arrival time of the newest snapshot
+    /// @pre size() > 0
+    [[nodiscard]]
+    time_point newest_time() const
+    {
+        return _times[slot(_size - 1)];
+    }
+
+    /// @brief Projects every entity in the newest snapshot along its velocity
+    /// to time, but no further than limit past the snapshot
+    /// @pre size() > 0 and time is after newest_time()
+    /// @param out as for interpolate()
+    void extrapolate(
+      render_time_point time, milliseconds_d limit, std::span<double> out
+    ) const;
+
+    /// @brief Drops the snapshots before index, in constant time
+    void evict_before(std::size_t index);
+
+    /// @brief Marks the entity in the slot of entity_id as missing from every
+    /// snapshot held, so a new entity reusing the slot isn't interpolated from
+    /// the old one's positions
+    void forget(std::size_t entity_id);
+
+private:
+    // Indexed by slot, one per row
+    std::vector<time_point> _times;
+
+    // capacity() rows of _stride positions, and of their velocities
+    std::vector<double> _positions;
+    std::vector<double> _velocities;
+    std::size_t _stride{0};
+
+    // Column of every entity, indexed by entity_index()
+    std::vector<uint32_t> _columns;
+
+    // Indexed by column: the id of the entity in it, and the push that last
+    // had it, so the column is free once that push has been evicted
+    std::vector<std::size_t> _column_ids;
+    std::vector<uint64_t> _last_pushes;
+    std::vector<uint32_t> _free_columns;
+    uint64_t _pushes{0};
+
+    // One row, interpolated before being scattered into entity order
+    std::vector<double> _scratch;
+
+    // Slot of the oldest snapshot
+    std::size_t _head{0};
+    std::size_t _size{0};
+
+    [[nodiscard]]
+    std::size_t slot(std::size_t index) const
+    {
+        return (_head + index) % _times.size();
+    }
+
+    [[nodiscard]]
+    std::span<const double> row(std::size_t index) const;
+
+    [[nodiscard]]
+    std::span<const double> velocity_row(std::size_t index) const;
+
+    [[nodiscard]]
+    uint32_t column(std::size_t entity_id);
+
+    void release(uint32_t column);
+
+    void widen(std::size_t columns);
+};
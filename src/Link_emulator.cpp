@@ -0,0 +1,126 @@
+#include "Link_emulator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+std::mt19937_64 make_random(uint64_t seed, uint64_t stream)
+{
+    std::seed_seq sequence{
+      static_cast<uint32_t>(seed),
+      static_cast<uint32_t>(seed >> 32U),
+      static_cast<uint32_t>(stream),
+      static_cast<uint32_t>(stream >> 32U)};
+    return std::mt19937_64(sequence);
+}
+
+}  // namespace
+
+Link_emulator::Link_emulator(const Link_config& config, uint64_t stream)
+  : _config(config),
+    _random(make_random(config.seed, stream)),
+    _tokens(static_cast<double>(config.burst_bytes))
+{}
+
+void Link_emulator::config(const Link_config& config)
+{
+    _config = config;
+}
+
+Link_delivery Link_emulator::transmit(std::size_t bytes, clock::time_point now)
+{
+    ++_stats.packets;
+
+    if (_bursting ? chance(_config.burst_end) : chance(_config.burst_start)) {
+        _bursting = !_bursting;
+    }
+
+    if (_bursting && chance(_config.burst_loss)) {
+        ++_stats.burst_lost;
+        return {};
+    }
+
+    if (chance(_config.loss)) {
+        ++_stats.lost;
+        return {};
+    }
+
+    std::chrono::microseconds queue_delay{0};
+
+    if (_config.bandwidth > 0.0) {
+        const auto burst = static_cast<double>(_config.burst_bytes);
+        const std::chrono::duration<double> elapsed = now - _last_refill;
+        _tokens = std::min(burst, _tokens + elapsed.count() * _config.bandwidth);
+        _last_refill = now;
+
+        // Tokens go negative while packets queue, the debt is how long the
+        // queue takes to drain
+        const double debt = static_cast<double>(bytes) - _tokens;
+        if (debt > 0.0) {
+            queue_delay = std::chrono::microseconds{
+              static_cast<int64_t>(std::ceil(debt / _config.bandwidth * 1e6))};
+
+            if (queue_delay > _config.max_queue_delay) {
+                ++_stats.queue_dropped;
+                return {};
+            }
+            ++_stats.throttled;
+        }
+
+        _tokens -= static_cast<double>(bytes);
+    }
+
+    Link_delivery delivery;
+    delivery.copies = chance(_config.duplicate) ? 2 : 1;
+    if (delivery.copies == 2) {
+        ++_stats.duplicated;
+    }
+
+    for (std::size_t i = 0; i < delivery.copies; ++i) {
+        auto delay = queue_delay + sample_delay();
+
+        if (chance(_config.reorder)) {
+            delay += _config.reorder_delay;
+            ++_stats.reordered;
+        }
+
+        delivery.delays[i] = delay;
+    }
+
+    return delivery;
+}
+
+bool Link_emulator::chance(double probability)
+{
+    // Keeps the random sequence, and so the outcome of every other decision,
+    // the same whether or not a feature is enabled
+    const double roll = std::uniform_real_distribution<double>(0.0, 1.0)(_random);
+    return roll < probability;
+}
+
+std::chrono::microseconds Link_emulator::sample_delay()
+{
+    const auto latency = static_cast<double>(_config.latency.count());
+    const auto jitter = static_cast<double>(_config.jitter.count());
+
+    double delay{latency};
+
+    if (_config.jitter.count() > 0) {
+        switch (_config.distribution) {
+        case Jitter_distribution::uniform:
+            delay +=
+              std::uniform_real_distribution<double>(-jitter, jitter)(_random);
+            break;
+        case Jitter_distribution::normal:
+            delay += std::normal_distribution<double>(0.0, jitter)(_random);
+            break;
+        case Jitter_distribution::exponential:
+            delay += std::exponential_distribution<double>(1.0 / jitter)(_random);
+            break;
+        }
+    }
+
+    return std::chrono::microseconds{
+      static_cast<int64_t>(std::llround(std::max(delay, 0.0)))};
+}
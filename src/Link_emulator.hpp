@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+enum class Jitter_distribution : uint8_t {
+    // latency +- jitter, evenly spread
+    uniform,
+
+    // latency with a standard deviation of jitter
+    normal,
+
+    // latency plus an exponential tail with a mean of jitter, mostly close to
+    // latency with the occasional large spike
+    exponential,
+};
+
+/// @brief Conditions of one direction of an emulated link
+///
+/// Probabilities are per packet, in [0, 1].
+struct Link_config {
+    std::chrono::microseconds latency{0};
+    std::chrono::microseconds jitter{0};
+    Jitter_distribution distribution{Jitter_distribution::uniform};
+
+    // Chance of a packet being lost outside of a burst
+    double loss{0.0};
+
+    // Bursts of loss follow the Gilbert-Elliott model: a packet moves the link
+    // into the bursty state with burst_start and back out with burst_end, and
+    // packets in it are lost with burst_loss
+    double burst_start{0.0};
+    double burst_end{1.0};
+    double burst_loss{1.0};
+
+    double duplicate{0.0};
+
+    // Chance of a packet being held back by reorder_delay, letting later
+    // packets overtake it
+    double reorder{0.0};
+    std::chrono::microseconds reorder_delay{std::chrono::milliseconds{20}};
+
+    // Token bucket: refilled at bandwidth bytes per second up to burst_bytes.
+    // Packets beyond it queue until there are tokens for them, or are dropped
+    // if they would queue for longer than max_queue_delay. 0 is unlimited.
+    double bandwidth{0.0};
+    std::size_t burst_bytes{16 * 1024};
+    std::chrono::microseconds max_queue_delay{std::chrono::milliseconds{200}};
+
+    // In-process links cost updates at Wire_format::estimated_size(). Encoding
+    // them instead is exact, but costs O(states) per client per tick.
+    bool encode_updates{false};
+
+    uint64_t seed{1};
+};
+
+struct Link_stats {
+    uint64_t packets{0};
+    uint64_t lost{0};
+    uint64_t burst_lost{0};
+    uint64_t duplicated{0};
+    uint64_t reordered{0};
+    uint64_t throttled{0};
+    uint64_t queue_dropped{0};
+
+    Link_stats& operator+=(Link_stats const& other)
+    {
+        packets += other.packets;
+        lost += other.lost;
+        burst_lost += other.burst_lost;
+        duplicated += other.duplicated;
+        reordered += other.reordered;
+        throttled += other.throttled;
+        queue_dropped += other.queue_dropped;
+        return *this;
+    }
+};
+
+/// @brief Copies of a packet that make it across, and after how long each
+struct Link_delivery {
+    std::size_t copies{0};
+    std::array<std::chrono::microseconds, 2> delays{};
+};
+
+/// @brief Decides what happens to each packet sent over an emulated link
+///
+/// All randomness comes from a generator seeded from the config's seed and a
+/// stream number, so the same seed, stream and sequence of packets always give
+/// the same deliveries. Links emulated side by side should use different
+/// streams. Not thread-safe, use one per link direction.
+class Link_emulator {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit Link_emulator(Link_config const& config = {}, uint64_t stream = 0);
+
+    /// @brief Changes the link's conditions, keeping its random sequence,
+    /// bursty state and tokens
+    void config(Link_config const& config);
+
+    [[nodiscard]]
+    Link_config const& config() const
+    {
+        return _config;
+    }
+
+    /// @brief Sends a packet of bytes over the link at now
+    [[nodiscard]]
+    Link_delivery transmit(std::size_t bytes, clock::time_point now);
+
+    [[nodiscard]]
+    Link_stats const& stats() const
+    {
+        return _stats;
+    }
+
+private:
+    Link_config _config;
+    std::mt19937_64 _random;
+    Link_stats _stats;
+
+    bool _bursting{false};
+
+    double _tokens{0.0};
+    clock::time_point _last_refill{};
+
+    [[nodiscard]]
+    bool chance(double probability);
+
+    [[nodiscard]]
+    std::chrono::microseconds sample_delay();
+};
@@ -0,0 +1,142 @@
+#include "Local_transport.hpp"
+
+#include "Client.hpp"
+#include "Entity_registry.hpp"
+#include "Server.hpp"
+
+Local_server_transport::Local_server_transport(const Link_config& config)
+  : _config(config)
+{}
+
+void Local_server_transport::attach(std::size_t entity_id, Client* client)
+{
+    const auto index = entity_index(entity_id);
+    if (index + 1 > _links.size()) {
+        _links.resize(index + 1);
+    }
+
+    // Downlinks take the even streams, uplinks the odd ones
+    _links[index] = std::make_unique<Link>(
+      client, Link_emulator(_config, uint64_t{2} * entity_id), entity_id
+    );
+}
+
+void Local_server_transport::detach(std::size_t entity_id)
+{
+    if (find(entity_id) != nullptr) {
+        _links[entity_index(entity_id)].reset();
+    }
+}
+
+Local_server_transport::Link*
+Local_server_transport::find(std::size_t entity_id) const
+{
+    const auto index = entity_index(entity_id);
+    if (index >= _links.size() || !_links[index] || _links[index]->id != entity_id) {
+        return nullptr;
+    }
+    return _links[index].get();
+}
+
+void Local_server_transport::link(const Link_config& config)
+{
+    _config = config;
+
+    for (auto& link : _links) {
+        if (link) {
+            const std::scoped_lock lock(link->mutex);
+            link->emulator.config(config);
+        }
+    }
+}
+
+Link_stats Local_server_transport::link_stats()
+{
+    Link_stats total;
+
+    for (auto& link : _links) {
+        if (!link) {
+            continue;
+        }
+
+        const std::scoped_lock lock(link->mutex);
+        total += link->emulator.stats();
+    }
+
+    return total;
+}
+
+void Local_server_transport::send(
+  std::size_t entity_id, const Server_update& update
+)
+{
+    auto* found = find(entity_id);
+    if (found == nullptr) {
+        return;
+    }
+
+    auto& link = *found;
+
+    // The link runs on the receiving client's time, like the delays it adds
+    const auto now = link.client->clock().now();
+
+    std::size_t size{0};
+    Link_delivery delivery;
+    {
+        const std::scoped_lock lock(link.mutex);
+
+        // Costed at what it would take on the wire, like the UDP backend
+        if (link.emulator.config().encode_updates) {
+            link.buffer.resize(_wire_format.max_size(update));
+            size = _wire_format.encode(update, link.buffer);
+            if (size == 0) {
+                return;
+            }
+        }
+        else {
+            size = _wire_format.estimated_size(update);
+        }
+
+        delivery = link.emulator.transmit(size, now);
+    }
+    link.traffic.record(size);
+
+    for (std::size_t i = 0; i < delivery.copies; ++i) {
+        link.client->send(update, delivery.delays[i]);
+    }
+}
+
+Local_client_transport::Local_client_transport(
+  Server& server, const Link_config& config, uint64_t stream
+)
+  : _server(&server),
+    _link(config, 2 * stream + 1),
+    _message_size(Wire_format{}.max_client_message_size())
+{}
+
+void Local_client_transport::send(const Client_message& msg)
+{
+    _batcher.add(msg);
+}
+
+void Local_client_transport::send(const Client_ack& ack)
+{
+    transmit(ack);
+}
+
+void Local_client_transport::flush()
+{
+    if (const auto batch = _batcher.take()) {
+        transmit(*batch);
+    }
+}
+
+template <typename Message>
+void Local_client_transport::transmit(const Message& msg)
+{
+    const auto delivery = _link.transmit(_message_size, _server->clock().now());
+
+    for (std::size_t i = 0; i < delivery.copies; ++i) {
+        _server->send(msg, delivery.delays[i]);
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Input_batcher.hpp"
+#include "Link_emulator.hpp"
+#include "Transport.hpp"
+#include "Wire_format.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// @brief In-process backend that hands messages straight to the receiver's queue
+///
+/// Nothing is serialized unless Link_config::encode_updates asks for exact
+/// costing; the only cost is the copy into the receiver's delay queue. Each
+/// client's downlink goes through its own Link_emulator, which decides how
+/// late, how often and whether an update is delivered.
+class Local_server_transport final : public Server_transport {
+    struct Link {
+        Link(Client* receiver, Link_emulator link_emulator, std::size_t entity_id)
+          : client(receiver),
+            emulator(link_emulator),
+            traffic(entity_id),
+            id(entity_id)
+        {}
+
+        Client* client;
+        Link_emulator emulator;
+        Client_traffic traffic;
+        std::size_t id;
+
+        // With Link_config::encode_updates, updates are encoded here only to
+        // be costed, the client is handed the update itself
+        std::vector<std::byte> buffer;
+
+        // Only contended when the conditions are changed mid-run
+        std::mutex mutex;
+    };
+
+    Link_config _config;
+    Wire_format _wire_format;
+    // Indexed by entity_index()
+    std::vector<std::unique_ptr<Link>> _links;
+
+    // The link of entity_id, nullptr if it isn't attached
+    [[nodiscard]]
+    Link* find(std::size_t entity_id) const;
+
+public:
+    explicit Local_server_transport(Link_config const& config = {});
+
+    /// @brief Routes updates for entity_id to client
+    ///
+    /// Its link draws from its own random stream, derived from the configured
+    /// seed and entity_id. Not safe to call while updates are being sent.
+    void attach(std::size_t entity_id, Client* client);
+
+    /// @brief Stops routing updates for entity_id, e.g. once it is despawned.
+    /// Not safe to call while updates are being sent.
+    void detach(std::size_t entity_id) override;
+
+    /// @brief Changes the conditions of every link. Safe to call while updates
+    /// are being sent.
+    void link(Link_config const& config);
+
+    [[nodiscard]]
+    Link_config const& link() const
+    {
+        return _config;
+    }
+
+    /// @brief Totals of every link's stats
+    [[nodiscard]]
+    Link_stats link_stats();
+
+    void send(std::size_t entity_id, Server_update const& update) override;
+    void flush() override {}
+    void poll(Server& /*server*/) override {}
+};
+
+/// @brief In-process backend for client inputs, see Local_server_transport
+///
+/// Inputs are batched and handed over on flush(), once per network tick. Not
+/// thread-safe, like the Client it's used with.
+class Local_client_transport final : public Client_transport {
+    Server* _server;
+    Link_emulator _link;
+    Input_batcher _batcher;
+
+    // Messages are costed at their largest encoded size
+    std::size_t _message_size;
+
+public:
+    /// @param stream picks the uplink's random stream, give each client its own
+    Local_client_transport(
+      Server& server, Link_config const& config = {}, uint64_t stream = 0
+    );
+
+    void link(Link_config const& config) { _link.config(config); }
+
+    [[nodiscard]]
+    Link_config const& link() const
+    {
+        return _link.config();
+    }
+
+    [[nodiscard]]
+    Link_stats const& link_stats() const
+    {
+        return _link.stats();
+    }
+
+    void send(Client_message const& msg) override;
+    void send(Client_ack const& ack) override;
+    void flush() override;
+    void poll(Client& /*client*/) override {}
+
+private:
+    template <typename Message>
+    void transmit(Message const& msg);
+};
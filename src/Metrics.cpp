@@ -0,0 +1,238 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <ostream>
+#include <stdexcept>
+
+namespace metrics {
+
+namespace {
+
+// Values below sub_buckets get a bucket each. Above that, a value whose
+// highest set bit is b falls in group b - sub_bucket_bits, split by the
+// sub_bucket_bits bits below its highest.
+std::size_t bucket_index(uint64_t value)
+{
+    if (value < Histogram::sub_buckets) {
+        return value;
+    }
+
+    const auto shift =
+      static_cast<unsigned>(std::bit_width(value)) - Histogram::sub_bucket_bits - 1;
+    return Histogram::sub_buckets * (shift + 1) +
+      ((value >> shift) - Histogram::sub_buckets);
+}
+
+// Largest value that falls in bucket index
+uint64_t bucket_upper_bound(std::size_t index)
+{
+    if (index < Histogram::sub_buckets) {
+        return index;
+    }
+
+    const auto shift = index / Histogram::sub_buckets - 1;
+    const auto sub_bucket = index % Histogram::sub_buckets;
+    const uint64_t lower = (Histogram::sub_buckets + sub_bucket) << shift;
+    return lower + ((uint64_t{1} << shift) - 1);
+}
+
+const char* type_name(const Metric& metric)
+{
+    switch (metric.value.index()) {
+    case 0:
+        return "counter";
+    case 1:
+        return "gauge";
+    default:
+        return "summary";
+    }
+}
+
+// Writes name{labels,extra} without braces if there are no labels at all
+void write_series(
+  std::ostream& out,
+  const std::string& name,
+  std::string_view suffix,
+  const std::string& labels,
+  std::string_view extra = {}
+)
+{
+    out << name << suffix;
+    if (!labels.empty() || !extra.empty()) {
+        out << '{' << labels << (labels.empty() || extra.empty() ? "" : ",")
+            << extra << '}';
+    }
+    out << ' ';
+}
+
+}  // namespace
+
+Histogram::Histogram(double scale)
+  : _scale(scale)
+{}
+
+void Histogram::record(uint64_t value)
+{
+    _buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+
+    auto max = _max.load(std::memory_order_relaxed);
+    while (value > max &&
+           !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+double Histogram::sum() const
+{
+    return static_cast<double>(_sum.load(std::memory_order_relaxed)) * _scale;
+}
+
+double Histogram::max() const
+{
+    return static_cast<double>(_max.load(std::memory_order_relaxed)) * _scale;
+}
+
+double Histogram::quantile(double q) const
+{
+    // Buckets keep changing while they are read, so rank against what is
+    // actually seen rather than _count
+    std::array<uint64_t, bucket_count> counts{};
+    uint64_t total{0};
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    if (total == 0) {
+        return 0.0;
+    }
+
+    const auto rank = static_cast<uint64_t>(
+      std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(total))
+    );
+
+    uint64_t seen{0};
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        seen += counts[i];
+        if (seen >= std::max<uint64_t>(rank, 1)) {
+            const auto bound = std::min(
+              bucket_upper_bound(i), _max.load(std::memory_order_relaxed)
+            );
+            return static_cast<double>(bound) * _scale;
+        }
+    }
+
+    return max();
+}
+
+template <typename T, typename... Args>
+T& Registry::find_or_add(
+  std::string_view name,
+  std::string_view help,
+  std::string_view labels,
+  Args&&... args
+)
+{
+    const std::scoped_lock lock(_mutex);
+
+    // Every series of a name shares its type, the first one found will do
+    const auto same_name = _metrics.lower_bound({std::string(name), std::string()});
+    if (same_name != _metrics.end() && same_name->first.first == name &&
+        !std::holds_alternative<T>(same_name->second->value)) {
+        throw std::runtime_error(
+          "metric " + std::string(name) + " already registered as a " +
+          type_name(*same_name->second)
+        );
+    }
+
+    auto& metric = _metrics[{std::string(name), std::string(labels)}];
+    if (!metric) {
+        metric = std::make_unique<Metric>(
+          name, help, labels, std::in_place_type<T>, std::forward<Args>(args)...
+        );
+    }
+
+    return std::get<T>(metric->value);
+}
+
+Counter& Registry::counter(
+  std::string_view name, std::string_view help, std::string_view labels
+)
+{
+    return find_or_add<Counter>(name, help, labels);
+}
+
+Gauge& Registry::gauge(
+  std::string_view name, std::string_view help, std::string_view labels
+)
+{
+    return find_or_add<Gauge>(name, help, labels);
+}
+
+Histogram& Registry::histogram(
+  std::string_view name,
+  std::string_view help,
+  double scale,
+  std::string_view labels
+)
+{
+    return find_or_add<Histogram>(name, help, labels, scale);
+}
+
+void Registry::write_prometheus(std::ostream& out) const
+{
+    static constexpr std::array<std::pair<double, std::string_view>, 4> quantiles{
+      {{0.5, "quantile=\"0.5\""},
+       {0.9, "quantile=\"0.9\""},
+       {0.99, "quantile=\"0.99\""},
+       {0.999, "quantile=\"0.999\""}}};
+
+    const auto precision = out.precision(15);
+
+    const std::string* previous_name{nullptr};
+    visit([&](const Metric& metric) {
+        if (previous_name == nullptr || *previous_name != metric.name) {
+            out << "# HELP " << metric.name << ' ' << metric.help << '\n'
+                << "# TYPE " << metric.name << ' ' << type_name(metric) << '\n';
+            previous_name = &metric.name;
+        }
+
+        if (const auto* counter = std::get_if<Counter>(&metric.value)) {
+            write_series(out, metric.name, "", metric.labels);
+            out << counter->value() << '\n';
+        }
+        else if (const auto* gauge = std::get_if<Gauge>(&metric.value)) {
+            write_series(out, metric.name, "", metric.labels);
+            out << gauge->value() << '\n';
+        }
+        else if (const auto* histogram = std::get_if<Histogram>(&metric.value)) {
+            for (const auto& [q, quantile_label] : quantiles) {
+                write_series(out, metric.name, "", metric.labels, quantile_label);
+                out << histogram->quantile(q) << '\n';
+            }
+
+            write_series(out, metric.name, "_sum", metric.labels);
+            out << histogram->sum() << '\n';
+            write_series(out, metric.name, "_count", metric.labels);
+            out << histogram->count() << '\n';
+        }
+    });
+
+    out.precision(precision);
+}
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+std::string label(std::string_view name, std::size_t value)
+{
+    return std::string(name) + "=\"" + std::to_string(value) + '"';
+}
+
+}  // namespace metrics
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+/// @brief Live counters, gauges and histograms
+///
+/// Metrics are registered once, by name and labels, and then updated with
+/// relaxed atomics from whichever thread owns the work they measure; reading
+/// them never blocks the writers. The registry renders them in Prometheus text
+/// exposition format, or can be walked with visit() to show them elsewhere.
+namespace metrics {
+
+/// @brief Monotonically increasing total
+class Counter {
+public:
+    void add(uint64_t amount = 1)
+    {
+        _value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    uint64_t value() const
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> _value{0};
+};
+
+/// @brief Value that can go up and down, e.g. a queue depth
+class Gauge {
+public:
+    void set(double value) { _value.store(value, std::memory_order_relaxed); }
+
+    [[nodiscard]]
+    double value() const
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> _value{0.0};
+};
+
+/// @brief Distribution of non-negative integer samples in log-linear buckets
+///
+/// Like an HDR histogram, every power of two is split into sub_buckets equal
+/// buckets, so any value is kept to within 1 / sub_buckets of itself across
+/// the whole 64-bit range in a fixed amount of memory. Samples are recorded in
+/// whatever integer unit suits the caller; scale converts them to the unit
+/// exported, e.g. 1e-9 for nanoseconds exported as seconds.
+class Histogram {
+public:
+    static constexpr unsigned sub_bucket_bits{4};
+    static constexpr uint64_t sub_buckets{uint64_t{1} << sub_bucket_bits};
+    static constexpr std::size_t bucket_count{
+      sub_buckets * (65 - sub_bucket_bits)};
+
+    explicit Histogram(double scale = 1.0);
+
+    void record(uint64_t value);
+
+    [[nodiscard]]
+    double scale() const
+    {
+        return _scale;
+    }
+
+    [[nodiscard]]
+    uint64_t count() const
+    {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Total of every sample, scaled
+    [[nodiscard]]
+    double sum() const;
+
+    /// @brief Largest sample, scaled
+    [[nodiscard]]
+    double max() const;
+
+    /// @brief Value below which the fraction q of samples fall, scaled, or 0
+    /// if nothing has been recorded
+    [[nodiscard]]
+    double quantile(double q) const;
+
+private:
+    double _scale;
+    std::array<std::atomic<uint64_t>, bucket_count> _buckets{};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _max{0};
+};
+
+/// @brief A registered metric
+struct Metric {
+    std::string name;
+    std::string help;
+
+    // Prometheus label pairs without the braces, e.g. client="3"
+    std::string labels;
+
+    std::variant<Counter, Gauge, Histogram> value;
+
+    template <typename T, typename... Args>
+    Metric(
+      std::string_view metric_name,
+      std::string_view metric_help,
+      std::string_view metric_labels,
+      std::in_place_type_t<T> type,
+      Args&&... args
+    )
+      : name(metric_name),
+        help(metric_help),
+        labels(metric_labels),
+        value(type, std::forward<Args>(args)...)
+    {}
+};
+
+class Registry {
+public:
+    Registry() = default;
+
+    DISABLE_COPY(Registry);
+    DISABLE_MOVE(Registry);
+
+    /// @brief Registers a metric, or returns the one already registered under
+    /// name and labels
+    ///
+    /// Metrics are never removed, so the returned reference stays valid for the
+    /// registry's lifetime. Takes a lock: look metrics up once, not per update.
+    /// @throws std::runtime_error if name is already used by another kind of
+    ///   metric
+    Counter& counter(
+      std::string_view name, std::string_view help, std::string_view labels = {}
+    );
+    Gauge& gauge(
+      std::string_view name, std::string_view help, std::string_view labels = {}
+    );
+    Histogram& histogram(
+      std::string_view name,
+      std::string_view help,
+      double scale,
+      std::string_view labels = {}
+    );
+
+    /// @brief Calls visitor with every metric, ordered by name then labels
+    template <typename Visitor>
+    void visit(Visitor&& visitor) const
+    {
+        const std::scoped_lock lock(_mutex);
+        for (const auto& [key, metric] : _metrics) {
+            visitor(std::as_const(*metric));
+        }
+    }
+
+    /// @brief Writes every metric in Prometheus text exposition format;
+    /// histograms are written as summaries
+    void write_prometheus(std::ostream& out) const;
+
+private:
+    mutable std::mutex _mutex;
+    std::map<std::pair<std::string, std::string>, std::unique_ptr<Metric>>
+      _metrics;
+
+    template <typename T, typename... Args>
+    T& find_or_add(
+      std::string_view name,
+      std::string_view help,
+      std::string_view labels,
+      Args&&... args
+    );
+};
+
+/// @brief The process-wide registry the simulation reports to
+Registry& registry();
+
+/// @brief Formats a single label pair, e.g. label("client", 3) is client="3"
+std::string label(std::string_view name, std::size_t value);
+
+}  // namespace metrics
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/// @brief Bounded lock-free queue for any number of producer threads and a
+/// single consumer
+///
+/// Dmitry Vyukov's bounded queue: a power of two ring of cells, each with a
+/// sequence number saying whether it is free for the producer at a position or
+/// ready for the consumer. Producers only contend on a compare-and-swap of the
+/// enqueue position, and the consumer never blocks them.
+///
+/// Pushing to a full queue fails rather than waiting, the way a full socket
+/// buffer drops datagrams.
+template <typename T>
+class Mpsc_queue {
+public:
+    /// @param capacity Rounded up to a power of two
+    explicit Mpsc_queue(std::size_t capacity)
+      : _capacity(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+        _cells(std::make_unique<Cell[]>(_capacity))
+    {
+        for (std::size_t i = 0; i < _capacity; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    DISABLE_COPY(Mpsc_queue);
+    DISABLE_MOVE(Mpsc_queue);
+    ~Mpsc_queue() = default;
+
+    /// @brief Safe to call from any thread
+    /// @return false if the queue is full, value is then discarded
+    bool try_push(T value)
+    {
+        Cell* cell{nullptr};
+        std::size_t position = _enqueue_position.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell = &_cells[position & (_capacity - 1)];
+            const std::size_t sequence =
+              cell->sequence.load(std::memory_order_acquire);
+
+            // Wraps around, so only the sign of the difference is meaningful
+            const auto lag = static_cast<std::intptr_t>(sequence - position);
+
+            if (lag == 0) {
+                if (_enqueue_position.compare_exchange_weak(
+                      position, position + 1, std::memory_order_relaxed
+                    )) {
+                    break;
+                }
+            }
+            else if (lag < 0) {
+                // The consumer hasn't freed this cell from the previous lap
+                return false;
+            }
+            else {
+                // Another producer claimed this position first
+                position = _enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Consumer thread only
+    /// @return false if empty, or if the next producer hasn't finished writing
+    bool try_pop(T& out)
+    {
+        Cell& cell = _cells[_dequeue_position & (_capacity - 1)];
+        const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != _dequeue_position + 1) {
+            return false;
+        }
+
+        out = std::move(cell.value);
+
+        // Frees the cell for the producer one lap ahead
+        cell.sequence.store(
+          _dequeue_position + _capacity, std::memory_order_release
+        );
+        ++_dequeue_position;
+        return true;
+    }
+
+    /// @brief Pops everything that is ready, passing each to consume. Consumer
+    /// thread only.
+    /// @return the number of values consumed
+    template <typename Consumer>
+    std::size_t drain(Consumer&& consume)
+    {
+        std::size_t count{0};
+
+        T value;
+        while (try_pop(value)) {
+            consume(std::move(value));
+            ++count;
+        }
+
+        return count;
+    }
+
+    [[nodiscard]]
+    std::size_t capacity() const
+    {
+        return _capacity;
+    }
+
+private:
+    // Keeps the producers' position and the consumer's off each other's line
+    static constexpr std::size_t cache_line_size{64};
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::size_t _capacity;
+    std::unique_ptr<Cell[]> _cells;
+
+    alignas(cache_line_size) std::atomic<std::size_t> _enqueue_position{0};
+    alignas(cache_line_size) std::size_t _dequeue_position{0};
+};
@@ -0,0 +1,106 @@
+#include "Priority_accumulator.hpp"
+
+#include "Entity_registry.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void Priority_accumulator::select(
+  std::span<const Entity_state> candidates,
+  std::span<const Entity_state> baseline,
+  std::size_t own_id,
+  double center,
+  const Budget_config& config,
+  std::size_t keep,
+  std::vector<Entity_state>& out
+)
+{
+    out.clear();
+    _ranked.clear();
+
+    // Both are sorted by id, so the baseline is walked alongside
+    auto base = baseline.begin();
+
+    bool owned_kept{false};
+
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        const auto& state = candidates[i];
+
+        const auto index = entity_index(state.id);
+        if (index >= _priorities.size()) {
+            _priorities.resize(index + 1, 0.0F);
+            _ids.resize(index + 1, no_entity);
+        }
+
+        if (_ids[index] != state.id) {
+            _ids[index] = state.id;
+            _priorities[index] = 0.0F;
+        }
+
+        for (; base != baseline.end() && entity_before(base->id, state.id); ++base) {
+        }
+
+        // New to the client counts as moving by change_scale
+        const double change = base != baseline.end() && base->id == state.id
+          ? std::abs(state.position - base->position)
+          : config.change_scale;
+        const double distance = std::abs(state.position - center);
+
+        _priorities[index] += static_cast<float>(
+          (1.0 + change / config.change_scale) /
+          (1.0 + distance / config.distance_scale)
+        );
+
+        if (state.id == own_id) {
+            owned_kept = true;
+            _ranked.emplace_back(std::numeric_limits<float>::infinity(), i);
+        }
+        else {
+            _ranked.emplace_back(_priorities[index], i);
+        }
+    }
+
+    if (owned_kept) {
+        keep = std::max<std::size_t>(keep, 1);
+    }
+    keep = std::min(keep, _ranked.size());
+    if (keep == 0) {
+        return;
+    }
+
+    // Highest first, ties to the lowest id so the choice is reproducible
+    const auto higher = [](const auto& lhs, const auto& rhs) {
+        if (lhs.first > rhs.first || rhs.first > lhs.first) {
+            return lhs.first > rhs.first;
+        }
+        return lhs.second < rhs.second;
+    };
+    std::nth_element(
+      _ranked.begin(),
+      _ranked.begin() + static_cast<std::ptrdiff_t>(keep - 1),
+      _ranked.end(),
+      higher
+    );
+
+    // Back into id order for the update
+    _ranked.resize(keep);
+    std::sort(_ranked.begin(), _ranked.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second < rhs.second;
+    });
+
+    for (const auto& [priority, i] : _ranked) {
+        out.push_back(candidates[i]);
+        _priorities[entity_index(candidates[i].id)] = 0.0F;
+    }
+}
+
+void Priority_accumulator::reset(std::span<const Entity_state> sent)
+{
+    for (const auto& state : sent) {
+        const auto index = entity_index(state.id);
+        if (index < _priorities.size()) {
+            _priorities[index] = 0.0F;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Server_update.hpp"
+
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+/// @brief How many bytes each client's update may take, and how the entity
+/// states that don't fit are picked
+///
+/// Entities are ranked by a priority that accumulates every tick they have a
+/// change the client hasn't been sent, faster the nearer they are to the
+/// client's own entity and the more they moved, and is reset once sent. Far or
+/// slow entities are deferred first but still get through eventually.
+struct Budget_config {
+    // Encoded bytes per update, 0 for no limit
+    std::size_t bytes{0};
+
+    // Distance at which priority grows half as fast as right next to the client
+    double distance_scale{16.0};
+
+    // Change in position that makes priority grow twice as fast as a tiny one
+    double change_scale{1.0};
+
+    [[nodiscard]]
+    bool enabled() const
+    {
+        return bytes != 0;
+    }
+};
+
+/// @brief A client's per-entity priorities, see Budget_config
+///
+/// Indexed by entity_index(), so it is as large as the most entities alive at
+/// once, and only ever grows while the budget is in use.
+class Priority_accumulator {
+    std::vector<float> _priorities;
+
+    // Id each priority was accumulated for, a new entity in the slot starts
+    // from 0 rather than inheriting it
+    std::vector<std::size_t> _ids;
+
+    // Priority and index into the candidates, reused between calls
+    std::vector<std::pair<float, std::size_t>> _ranked;
+
+public:
+    /// @brief Accumulates the priority of every candidate and writes the keep
+    /// highest into out, sorted by id, resetting theirs
+    ///
+    /// The client's own entity is always kept, even if keep is 0, since
+    /// reconciliation depends on it.
+    /// @param candidates states the client should be sent, sorted by id
+    /// @param baseline what the client holds, sorted by id, to measure changes
+    ///  against
+    /// @param own_id id of the client's entity, at center
+    void select(
+      std::span<Entity_state const> candidates,
+      std::span<Entity_state const> baseline,
+      std::size_t own_id,
+      double center,
+      Budget_config const& config,
+      std::size_t keep,
+      std::vector<Entity_state>& out
+    );
+
+    /// @brief Resets the priorities of sent, for when the client was sent
+    /// every candidate
+    ///
+    /// Deferred entities stay candidates until they are sent, so every other
+    /// priority is already 0 and the cost is O(sent), not O(slots).
+    void reset(std::span<Entity_state const> sent);
+};
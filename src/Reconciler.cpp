@@ -0,0 +1,84 @@
+#include "Reconciler.hpp"
+
+#include "Trace.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+Reconciler::Reconciler(std::size_t capacity, double threshold)
+  : _entries(std::max<std::size_t>(capacity, 1)),
+    _threshold(threshold)
+{}
+
+void Reconciler::record(const Client_message& msg, double predicted_position)
+{
+    auto& entry = _entries[msg.sequence_number % _entries.size()];
+    entry.sequence_number = msg.sequence_number;
+    entry.duration = msg.duration.count();
+    entry.position = predicted_position;
+    entry.stale = false;
+
+    _newest = std::max(_newest, msg.sequence_number);
+}
+
+double Reconciler::reconcile(
+  uint32_t last_processed_input,
+  double authoritative_position,
+  double predicted_position
+)
+{
+    const Entry* acknowledged = find(last_processed_input);
+    if (acknowledged != nullptr && !acknowledged->stale &&
+        std::abs(acknowledged->position - authoritative_position) <= _threshold) {
+        return predicted_position;
+    }
+
+    // Nothing was predicted past what the server has processed, its position
+    // is simply the right one
+    if (_newest <= last_processed_input) {
+        return authoritative_position;
+    }
+
+    // The inputs right after the one processed were overwritten, replaying the
+    // rest without them would put the entity somewhere it never was
+    if (_newest - last_processed_input > _entries.size()) {
+        ++_snaps;
+        for (auto& entry : _entries) {
+            entry.stale = true;
+        }
+        return authoritative_position;
+    }
+
+    ++_replays;
+
+    trace::record<trace::Event::client_replay>(
+      last_processed_input + 1, _newest, authoritative_position
+    );
+
+    double position = authoritative_position;
+    for (uint32_t sequence_number = last_processed_input + 1;
+         sequence_number <= _newest;
+         ++sequence_number) {
+        Entry* entry = find(sequence_number);
+        if (entry == nullptr) {
+            continue;
+        }
+
+        position = update_position(position, entry->duration);
+
+        // Later updates are checked against the corrected prediction
+        entry->position = position;
+        entry->stale = false;
+    }
+
+    return position;
+}
+
+Reconciler::Entry* Reconciler::find(uint32_t sequence_number)
+{
+    auto& entry = _entries[sequence_number % _entries.size()];
+    return entry.sequence_number == sequence_number && sequence_number != 0
+      ? &entry
+      : nullptr;
+}
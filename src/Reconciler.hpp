@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Command_message.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Inputs remembered for replay unless configured otherwise, about four
+/// seconds of 60 Hz input
+constexpr std::size_t default_reconciliation_capacity{256};
+
+/// @brief Largest distance between the predicted and authoritative position
+/// that is still accepted as a match, unless configured otherwise. Above the
+/// wire format's quantization error.
+constexpr double default_reconciliation_threshold{1.0 / 16.0};
+
+/// @brief Corrects client-side prediction against the server's positions
+///
+/// Each predicted input is stored in a fixed-capacity ring indexed by sequence
+/// number, along with the position the client predicted it would lead to. When
+/// an update arrives, the server's position is compared with the prediction for
+/// the last input it processed. Only if they differ by more than the threshold
+/// are the inputs since replayed on top of the server's position, so the common
+/// case costs a single lookup.
+///
+/// Inputs older than capacity are overwritten and can't be replayed anymore. If
+/// the server falls that far behind, the entity snaps to its position instead,
+/// and the predictions still kept, made from the wrong one, are all replayed on
+/// the next update rather than trusted.
+class Reconciler {
+public:
+    explicit Reconciler(
+      std::size_t capacity = default_reconciliation_capacity,
+      double threshold = default_reconciliation_threshold
+    );
+
+    /// @brief Remembers an input and where the client predicted it would take
+    /// its entity
+    void record(Client_message const& msg, double predicted_position);
+
+    /// @param last_processed_input The newest input reflected in
+    ///  authoritative_position
+    /// @param predicted_position Where the client currently has its entity
+    /// @return where the client should have its entity now
+    [[nodiscard]]
+    double reconcile(
+      uint32_t last_processed_input,
+      double authoritative_position,
+      double predicted_position
+    );
+
+    /// @brief Number of times the prediction was off and inputs were replayed
+    [[nodiscard]]
+    uint64_t replays() const
+    {
+        return _replays;
+    }
+
+    /// @brief Number of times inputs the server hadn't processed yet were
+    /// already overwritten, so the entity snapped to the server's position
+    [[nodiscard]]
+    uint64_t snaps() const
+    {
+        return _snaps;
+    }
+
+private:
+    struct Entry {
+        uint32_t sequence_number{0};
+        double duration{0.0};
+        double position{0.0};
+
+        // Predicted from a position the server has since snapped the entity
+        // away from, so it can't confirm a match
+        bool stale{false};
+    };
+
+    std::vector<Entry> _entries;
+    double _threshold;
+    uint32_t _newest{0};
+    uint64_t _replays{0};
+    uint64_t _snaps{0};
+
+    [[nodiscard]]
+    Entry* find(uint32_t sequence_number);
+};
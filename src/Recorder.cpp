@@ -0,0 +1,393 @@
+#include "Recorder.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace {
+
+using recording::Record_header;
+
+constexpr std::size_t record_alignment{8};
+
+std::size_t align(std::size_t size)
+{
+    return (size + record_alignment - 1) / record_alignment * record_alignment;
+}
+
+template <typename T>
+std::span<const std::byte> bytes_of(const T& value)
+{
+    return std::as_bytes(std::span<const T>(&value, 1));
+}
+
+#ifndef _WIN32
+[[noreturn]]
+void throw_errno(const std::string& what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+#else
+[[noreturn]]
+void throw_unsupported()
+{
+    throw std::system_error(
+      std::make_error_code(std::errc::function_not_supported),
+      "recordings need mmap"
+    );
+}
+#endif
+
+// Copies a payload of exactly one T out of record
+template <typename T>
+bool read_payload(const Record& record, T& out)
+{
+    if (record.payload.size() < sizeof(T)) {
+        return false;
+    }
+
+    std::memcpy(&out, record.payload.data(), sizeof(T));
+    return true;
+}
+
+}  // namespace
+
+Recorder::Recorder(
+  const std::string& path, std::size_t capacity, Clock const& clock
+)
+  : _capacity(std::max(capacity, sizeof(recording::File_header))),
+    _clock(&clock),
+    _start(clock.now())
+{
+#ifndef _WIN32
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        throw_errno("open " + path);
+    }
+
+    if (::ftruncate(_fd, static_cast<off_t>(_capacity)) != 0) {
+        ::close(_fd);
+        throw_errno("ftruncate " + path);
+    }
+
+    void* data =
+      ::mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED) {
+        ::close(_fd);
+        throw_errno("mmap " + path);
+    }
+
+    // Written front to back, let the kernel read ahead and drop behind
+    ::madvise(data, _capacity, MADV_SEQUENTIAL);
+    _data = static_cast<std::byte*>(data);
+
+    const recording::File_header header{
+      .magic = recording::magic, .version = recording::version, .reserved = 0};
+    std::memcpy(_data, &header, sizeof(header));
+#else
+    (void)path;
+    throw_unsupported();
+#endif
+}
+
+Recorder::~Recorder()
+{
+#ifndef _WIN32
+    const auto end = std::min(_end.load(), _capacity);
+
+    ::munmap(_data, _capacity);
+
+    // Give back the sparse tail nothing was written to
+    if (::ftruncate(_fd, static_cast<off_t>(end)) != 0) {
+        // Nothing sensible to do in a destructor; the file is still readable
+    }
+    ::close(_fd);
+#endif
+}
+
+std::size_t Recorder::size() const
+{
+    return std::min(_end.load(std::memory_order_relaxed), _capacity) -
+      sizeof(recording::File_header);
+}
+
+void Recorder::append(
+  Record_type type, std::initializer_list<std::span<const std::byte>> parts
+)
+{
+    std::size_t payload_size{0};
+    for (const auto& part : parts) {
+        payload_size += part.size();
+    }
+
+    const auto size = align(sizeof(Record_header) + payload_size);
+    const auto offset = _end.fetch_add(size, std::memory_order_relaxed);
+
+    if (size > std::numeric_limits<uint32_t>::max() || offset + size > _capacity) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::byte* out = _data + offset;
+
+    const Record_header header{
+      .size = 0,
+      .type = type,
+      .reserved = 0,
+      .time_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(_clock->now() - _start)
+          .count()};
+    std::memcpy(out, &header, sizeof(header));
+
+    std::byte* cursor = out + sizeof(header);
+    for (const auto& part : parts) {
+        std::memcpy(cursor, part.data(), part.size());
+        cursor += part.size();
+    }
+
+    // The size marks the record complete, so it goes in last
+    const auto complete_size = static_cast<uint32_t>(size);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(
+      out + offsetof(Record_header, size), &complete_size, sizeof(complete_size)
+    );
+}
+
+void Recorder::connect(std::size_t entity_id, double spawn_position)
+{
+    const recording::Connect payload{
+      .entity_id = entity_id, .spawn_position = spawn_position};
+    append(Record_type::connect, {bytes_of(payload)});
+}
+
+void Recorder::spawn(std::size_t entity_id, double position)
+{
+    const recording::Connect payload{
+      .entity_id = entity_id, .spawn_position = position};
+    append(Record_type::spawn, {bytes_of(payload)});
+}
+
+void Recorder::despawn(std::size_t entity_id)
+{
+    const recording::Despawn payload{.entity_id = entity_id};
+    append(Record_type::despawn, {bytes_of(payload)});
+}
+
+void Recorder::input(const Input_batch& batch)
+{
+    append(Record_type::input, {bytes_of(batch)});
+}
+
+void Recorder::ack(const Client_ack& ack)
+{
+    append(Record_type::ack, {bytes_of(ack)});
+}
+
+void Recorder::update_sent(std::size_t entity_id, const Server_update& update)
+{
+    this->update(Record_type::update_sent, entity_id, update);
+}
+
+void Recorder::update_received(std::size_t entity_id, const Server_update& update)
+{
+    this->update(Record_type::update_received, entity_id, update);
+}
+
+void Recorder::update(
+  Record_type type, std::size_t entity_id, const Server_update& update
+)
+{
+    const recording::Update header{
+      .entity_id = entity_id,
+      .tick = update.tick,
+      .baseline_tick = update.baseline_tick,
+      .last_processed_input = update.last_processed_input,
+      .states_count = static_cast<uint32_t>(update.states.size()),
+      .removed_count = update.removed.size()};
+
+    append(
+      type,
+      {bytes_of(header), std::as_bytes(update.states), std::as_bytes(update.removed)}
+    );
+}
+
+void Recorder::client_frame(std::size_t entity_id)
+{
+    const recording::Client_frame payload{.entity_id = entity_id};
+    append(Record_type::client_frame, {bytes_of(payload)});
+}
+
+void Recorder::tick(uint32_t tick, milliseconds_d interval)
+{
+    const recording::Tick payload{
+      .tick = tick, .reserved = 0, .interval_ms = interval.count()};
+    append(Record_type::tick, {bytes_of(payload)});
+}
+
+Recording_reader::Recording_reader(const std::string& path)
+{
+#ifndef _WIN32
+    _fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) {
+        throw_errno("open " + path);
+    }
+
+    struct stat status {};
+    if (::fstat(_fd, &status) != 0) {
+        ::close(_fd);
+        throw_errno("fstat " + path);
+    }
+
+    _size = static_cast<std::size_t>(status.st_size);
+    if (_size < sizeof(recording::File_header)) {
+        ::close(_fd);
+        throw std::runtime_error(path + " is not a recording");
+    }
+
+    void* data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED) {
+        ::close(_fd);
+        throw_errno("mmap " + path);
+    }
+
+    // Replays read front to back
+    ::madvise(data, _size, MADV_SEQUENTIAL);
+    _data = static_cast<const std::byte*>(data);
+
+    recording::File_header header{};
+    std::memcpy(&header, _data, sizeof(header));
+    if (header.magic != recording::magic || header.version != recording::version) {
+        ::munmap(data, _size);
+        ::close(_fd);
+        throw std::runtime_error(
+          path + " is not a recording of version " +
+          std::to_string(recording::version)
+        );
+    }
+#else
+    (void)path;
+    throw_unsupported();
+#endif
+}
+
+Recording_reader::~Recording_reader()
+{
+#ifndef _WIN32
+    // Mapped read-only, munmap just doesn't take a const pointer
+    ::munmap(const_cast<std::byte*>(_data), _size);
+    ::close(_fd);
+#endif
+}
+
+std::optional<Record> Recording_reader::next()
+{
+    if (_offset + sizeof(Record_header) > _size) {
+        return std::nullopt;
+    }
+
+    Record_header header{};
+    std::memcpy(&header, _data + _offset, sizeof(header));
+
+    if (header.size < sizeof(Record_header) || _offset + header.size > _size) {
+        return std::nullopt;
+    }
+
+    const Record record{
+      .type = header.type,
+      .time = std::chrono::nanoseconds{header.time_ns},
+      .payload = std::span<const std::byte>(
+        _data + _offset + sizeof(Record_header), header.size - sizeof(Record_header)
+      )};
+
+    _offset += header.size;
+    return record;
+}
+
+void Recording_reader::rewind()
+{
+    _offset = sizeof(recording::File_header);
+}
+
+bool Recording_reader::read(const Record& record, recording::Connect& out)
+{
+    return read_payload(record, out);
+}
+
+bool Recording_reader::read(const Record& record, Input_batch& out)
+{
+    return read_payload(record, out);
+}
+
+bool Recording_reader::read(const Record& record, Client_ack& out)
+{
+    return read_payload(record, out);
+}
+
+bool Recording_reader::read(const Record& record, recording::Client_frame& out)
+{
+    return read_payload(record, out);
+}
+
+bool Recording_reader::read(const Record& record, recording::Despawn& out)
+{
+    return read_payload(record, out);
+}
+
+bool Recording_reader::read(const Record& record, recording::Tick& out)
+{
+    return read_payload(record, out);
+}
+
+bool Recording_reader::read(
+  const Record& record,
+  std::size_t& entity_id,
+  Server_update& out,
+  Update_storage& storage
+)
+{
+    recording::Update header{};
+    if (!read_payload(record, header)) {
+        return false;
+    }
+
+    // Counts from a corrupt log are checked by dividing what's left, the
+    // sizes they'd multiply out to could wrap
+    auto remaining = record.payload.size() - sizeof(header);
+    if (header.states_count > remaining / sizeof(Entity_state)) {
+        return false;
+    }
+    const auto states_size = header.states_count * sizeof(Entity_state);
+    remaining -= states_size;
+
+    if (header.removed_count > remaining / sizeof(std::size_t)) {
+        return false;
+    }
+    const auto removed_size = header.removed_count * sizeof(std::size_t);
+
+    const auto* states = record.payload.data() + sizeof(header);
+    storage.states.resize(header.states_count);
+    std::memcpy(storage.states.data(), states, states_size);
+
+    storage.removed.resize(header.removed_count);
+    std::memcpy(storage.removed.data(), states + states_size, removed_size);
+
+    entity_id = header.entity_id;
+    out.states = storage.states;
+    out.removed = storage.removed;
+    out.tick = header.tick;
+    out.baseline_tick = header.baseline_tick;
+    out.last_processed_input = header.last_processed_input;
+    return true;
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Clock.hpp"
+#include "Command_message.hpp"
+#include "common.hpp"
+#include "Server_update.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <string>
+
+/// @brief What a record in a recording holds
+enum class Record_type : uint16_t {
+    // Server::connect: entity id and spawn position
+    connect = 1,
+
+    // Input_batch or Client_ack the server applied, just before its tick
+    input,
+    ack,
+
+    // Server update handed to a client's transport
+    update_sent,
+
+    // Server update a client reconstructed, after the network had its way
+    update_received,
+
+    // A client finished processing what it received since the last frame
+    client_frame,
+
+    // The server finished a tick
+    tick,
+
+    // Server::spawn: entity id and position
+    spawn,
+
+    // Server::despawn: entity id
+    despawn,
+};
+
+/// @brief Layout of a recording
+///
+/// A file header, then records padded to 8 bytes, each a Record_header followed
+/// by its payload. Payloads are the in-memory representation of the messages;
+/// a recording is only meant to be read by the build that wrote it or one very
+/// close to it.
+namespace recording {
+
+constexpr std::array<char, 8> magic{'n', 'c', 'r', 'e', 'c', 'o', 'r', 'd'};
+constexpr uint32_t version{4};
+
+struct File_header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct Record_header {
+    // Of the whole record, header and padding included. 0 until the record is
+    // complete.
+    uint32_t size;
+    Record_type type;
+    uint16_t reserved;
+
+    // Since the recording started
+    int64_t time_ns;
+};
+
+// Of both connect and spawn records
+struct Connect {
+    uint64_t entity_id;
+    double spawn_position;
+};
+
+// Followed by states_count Entity_states, then removed_count entity ids
+struct Update {
+    uint64_t entity_id;
+    uint32_t tick;
+    uint32_t baseline_tick;
+    uint32_t last_processed_input;
+    uint32_t states_count;
+    uint64_t removed_count;
+};
+
+struct Client_frame {
+    uint64_t entity_id;
+};
+
+struct Despawn {
+    uint64_t entity_id;
+};
+
+struct Tick {
+    uint32_t tick;
+    uint32_t reserved;
+
+    // Server::tick_interval() the tick ran with
+    double interval_ms;
+};
+
+}  // namespace recording
+
+/// @brief Appends the messages of a session to a memory-mapped file
+///
+/// The file is created at its full capacity, sparsely, and mapped once.
+/// Appending reserves space with a single atomic add and copies the message
+/// straight into the mapping, so any thread can record without a lock or a
+/// system call. Records that don't fit once the capacity is used up are
+/// dropped and counted. The file is truncated to what was written on
+/// destruction.
+class Recorder {
+public:
+    /// @param clock What records are timestamped with, must outlive the
+    ///  recorder
+    /// @throws std::system_error if the file cannot be created or mapped
+    Recorder(
+      std::string const& path,
+      std::size_t capacity,
+      Clock const& clock = real_clock()
+    );
+    ~Recorder();
+
+    DISABLE_COPY(Recorder);
+    DISABLE_MOVE(Recorder);
+
+    void connect(std::size_t entity_id, double spawn_position);
+    void spawn(std::size_t entity_id, double position);
+    void despawn(std::size_t entity_id);
+    void input(Input_batch const& batch);
+    void ack(Client_ack const& ack);
+    void update_sent(std::size_t entity_id, Server_update const& update);
+    void update_received(std::size_t entity_id, Server_update const& update);
+    void client_frame(std::size_t entity_id);
+    void tick(uint32_t tick, milliseconds_d interval);
+
+    /// @brief Bytes of records written so far
+    [[nodiscard]]
+    std::size_t size() const;
+
+    /// @brief Records that didn't fit
+    [[nodiscard]]
+    uint64_t dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    int _fd{-1};
+    std::byte* _data{nullptr};
+    std::size_t _capacity;
+    Clock const* _clock;
+    Clock::time_point _start;
+
+    // Where the next record goes, past the end once the file is full
+    std::atomic<std::size_t> _end{sizeof(recording::File_header)};
+    std::atomic<uint64_t> _dropped{0};
+
+    // Writes a record of type whose payload is parts, one after the other
+    void append(
+      Record_type type, std::initializer_list<std::span<std::byte const>> parts
+    );
+
+    void update(
+      Record_type type, std::size_t entity_id, Server_update const& update
+    );
+};
+
+/// @brief A record read back from a recording
+struct Record {
+    Record_type type;
+    std::chrono::nanoseconds time;
+    std::span<std::byte const> payload;
+};
+
+/// @brief Reads the records of a file written by a Recorder, in file order
+///
+/// Records from different threads are in the order they reserved space in,
+/// which is the order they were recorded in for any one thread.
+class Recording_reader {
+public:
+    /// @throws std::system_error if the file cannot be opened or mapped
+    /// @throws std::runtime_error if it isn't a recording of this version
+    explicit Recording_reader(std::string const& path);
+    ~Recording_reader();
+
+    DISABLE_COPY(Recording_reader);
+    DISABLE_MOVE(Recording_reader);
+
+    /// @return nullopt at the end of the recording, or at a record that was
+    ///  never completed, e.g. if the recording process crashed
+    [[nodiscard]]
+    std::optional<Record> next();
+
+    /// @brief Starts over from the first record
+    void rewind();
+
+    /// @return false if payload is not of the expected size
+    [[nodiscard]]
+    static bool read(Record const& record, recording::Connect& out);
+    [[nodiscard]]
+    static bool read(Record const& record, Input_batch& out);
+    [[nodiscard]]
+    static bool read(Record const& record, Client_ack& out);
+    [[nodiscard]]
+    static bool read(Record const& record, recording::Client_frame& out);
+    [[nodiscard]]
+    static bool read(Record const& record, recording::Despawn& out);
+    [[nodiscard]]
+    static bool read(Record const& record, recording::Tick& out);
+
+    /// @brief Reads an update whose states and removals are copied into storage
+    /// @return false if the payload is malformed
+    [[nodiscard]]
+    static bool read(
+      Record const& record,
+      std::size_t& entity_id,
+      Server_update& out,
+      Update_storage& storage
+    );
+
+private:
+    int _fd{-1};
+    std::byte const* _data{nullptr};
+    std::size_t _size{0};
+    std::size_t _offset{sizeof(recording::File_header)};
+};
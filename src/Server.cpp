@@ -1,74 +1,443 @@
 #include "Server.hpp"
 
+#include "Trace.hpp"
 #include "Utils.hpp"
 
-#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <utility>
 
 using namespace std::chrono_literals;
 
-Server::Server(std::chrono::milliseconds network_delay)
-  : _network_delay(network_delay)
+Server::Server(
+  Server_transport& transport, std::size_t threads, Clock const& clock
+)
+  : _transport(&transport),
+    _clock(&clock),
+    _pool(threads),
+    _tick_duration(&metrics::registry().histogram(
+      "netcode_server_tick_duration_seconds", "Time spent in Server::update", 1e-9
+    )),
+    _inbound_depth(&metrics::registry().gauge(
+      "netcode_server_inbound_depth",
+      "Client messages handed to the server since the previous tick"
+    )),
+    _delayed_depth(&metrics::registry().gauge(
+      "netcode_server_delayed_depth",
+      "Client messages waiting out their network delay"
+    )),
+    _inbound_dropped_total(&metrics::registry().counter(
+      "netcode_server_inbound_dropped_total",
+      "Client messages dropped because the inbound queue was full"
+    )),
+    _states_deferred_total(&metrics::registry().counter(
+      "netcode_server_states_deferred_total",
+      "Changed entity states held back by the bandwidth budget"
+    ))
 {}
 
-std::size_t Server::connect(Client* client)
+std::size_t Server::connect(double spawn_position)
 {
-    const size_t entity_id{_clients.size()};
+    const auto entity_id = _entities.spawn(
+      Entity{.position = spawn_position, .client = _clients.size()}
+    );
 
-    _clients.push_back(client);
+    _clients.push_back(Connection{
+      .entity_id = entity_id,
+      .acked_tick = 0,
+      .last_processed_input = 0,
+      .sent = {},
+      .priorities = {}});
 
-    const Entity_state state{.position = 0.0, .id = entity_id};
-    _states.push_back(state);
-    _last_processed_inputs.push_back(0);
+    if (_recorder != nullptr) {
+        _recorder->connect(entity_id, spawn_position);
+    }
 
     return entity_id;
 }
 
-void Server::send(const Client_message& cmd, std::chrono::milliseconds delay)
+std::size_t Server::spawn(double position)
+{
+    const auto entity_id = _entities.spawn(Entity{.position = position});
+
+    if (_recorder != nullptr) {
+        _recorder->spawn(entity_id, position);
+    }
+
+    return entity_id;
+}
+
+bool Server::despawn(std::size_t entity_id)
+{
+    const auto* entity = _entities.find(entity_id);
+    if (entity == nullptr) {
+        return false;
+    }
+
+    // Fill the client's place with the last one
+    if (const auto index = entity->client; index != no_client) {
+        if (index + 1 != _clients.size()) {
+            _clients[index] = std::move(_clients.back());
+            _entities.get(_clients[index].entity_id).client = index;
+        }
+        _clients.pop_back();
+        _transport->detach(entity_id);
+    }
+
+    _entities.despawn(entity_id);
+
+    if (_recorder != nullptr) {
+        _recorder->despawn(entity_id);
+    }
+
+    return true;
+}
+
+void Server::send(const Input_batch& batch, std::chrono::microseconds delay)
 {
-    const Message msg{
-      .message = cmd, .recv_timestamp = std::chrono::system_clock::now() + delay};
+    enqueue(batch, delay);
+}
 
-    {
-        const std::scoped_lock lock(_queue_mutex);
-        _queue.push_back(msg);
+void Server::send(const Client_ack& ack, std::chrono::microseconds delay)
+{
+    enqueue(ack, delay);
+}
+
+void Server::enqueue(Inbound inbound, std::chrono::microseconds delay)
+{
+    const auto recv_timestamp = _clock->now() + delay;
+
+    if (!_inbound.try_push(Arrival{std::move(inbound), recv_timestamp})) {
+        _inbound_dropped.fetch_add(1, std::memory_order_relaxed);
+        _inbound_dropped_total->add();
     }
 }
 
 void Server::update()
 {
-    // Process client messages
-    {
-        const std::scoped_lock lock(_queue_mutex);
+    const auto start = std::chrono::steady_clock::now();
+    trace::record<trace::Event::tick_begin>(_tick + 1);
 
-        for (const auto& msg : _queue) {
+    _transport->poll(*this);
 
-            // Only process messages that get past the network delay
-            if (msg.recv_timestamp <= std::chrono::system_clock::now()) {
-                spdlog::info("[server] recv: (seq={}, duration={:.3f})", msg.message.sequence_number, msg.message.duration.count());
+    // Take everything handed over since the last tick in one batch, without
+    // blocking senders, then only process what got past the network delay
+    const auto arrived = _inbound.drain([this](Arrival&& arrival) {
+        _queue.push(std::move(arrival.first), arrival.second);
+    });
+    _inbound_depth->set(static_cast<double>(arrived));
 
-                auto id = msg.message.entity_id;
-                _states[id].position = update_position(_states[id].position, msg.message.duration.count());
-                _last_processed_inputs[id] = msg.message.sequence_number;
+    _due.clear();
+    _queue.pop_due(_clock->now(), _due);
+    _delayed_depth->set(static_cast<double>(_queue.size()));
+    _stats.inbound_dropped = _inbound_dropped.load(std::memory_order_relaxed);
 
-                spdlog::info("[server] update: position = {:.3f}", _states[id].position);
+    if (_recorder != nullptr) {
+        for (const auto& inbound : _due) {
+            if (const auto* batch = std::get_if<Input_batch>(&inbound)) {
+                _recorder->input(*batch);
+            }
+            else {
+                _recorder->ack(std::get<Client_ack>(inbound));
             }
         }
+    }
+
+    // Messages only touch their own entity, so entities are split across the
+    // pool while each one's messages keep their order
+    _shards.resize(_pool.size());
+    for (auto& shard : _shards) {
+        shard.clear();
+    }
+
+    for (std::size_t i = 0; i < _due.size(); ++i) {
+        const auto entity_id = std::visit(
+          [](const auto& inbound) { return inbound.entity_id; }, _due[i]
+        );
+        _shards[entity_id % _shards.size()].push_back(i);
+    }
+
+    _pool.parallel_for(_shards.size(), [this](std::size_t begin, std::size_t end) {
+        for (std::size_t shard = begin; shard < end; ++shard) {
+            for (const auto index : _shards[shard]) {
+                apply(_due[index]);
+            }
+        }
+    });
+
+    ++_tick;
+
+    _entities.compact();
+    _states.clear();
+    for (auto& entry : _entities.entries()) {
+        auto& entity = entry.value;
+        const double velocity = _tick_interval.count() > 0.0
+          ? entity.moved / seconds_d{_tick_interval}.count()
+          : 0.0;
+
+        _states.push_back(
+          {.position = entity.position, .id = entry.id, .velocity = velocity}
+        );
+
+        entity.moved = 0.0;
+    }
+
+    if (_interest.enabled()) {
+        _spatial_index.rebuild(_states);
+    }
+
+    // Every update this tick points into one shared storage. Its leading
+    // states are the full snapshot, followed by each client's delta or
+    // filtered view. Spans are only taken once it has stopped growing.
+    auto storage = _storage_pool.acquire();
+    storage->states.assign(_states.begin(), _states.end());
+
+    _pending.resize(_clients.size());
+
+    const std::shared_ptr<const Update_storage> shared_storage = storage;
+    _pool.parallel_for(
+      _clients.size(),
+      [this, &shared_storage](std::size_t begin, std::size_t end) {
+          for (std::size_t index = begin; index < end; ++index) {
+              prepare_update(index, shared_storage);
+          }
+      }
+    );
+
+    // The merge point: lay every update out in the storage in client order
+    std::size_t deferred{0};
+    for (auto& pending : _pending) {
+        if (pending.full_snapshot) {
+            pending.states_offset = 0;
+            pending.states_count = _states.size();
+        }
+        else {
+            pending.states_offset = storage->states.size();
+            pending.states_count = pending.states.size();
+            storage->states.insert(
+              storage->states.end(), pending.states.begin(), pending.states.end()
+            );
+        }
+
+        pending.removed_offset = storage->removed.size();
+        pending.removed_count = pending.removed.size();
+        storage->removed.insert(
+          storage->removed.end(), pending.removed.begin(), pending.removed.end()
+        );
+
+        if (pending.baseline_tick != 0) {
+            ++_stats.delta_snapshots;
+        }
+        else {
+            ++_stats.full_snapshots;
+        }
 
-        std::erase_if(_queue, [](const auto& msg) {
-            return msg.recv_timestamp <= std::chrono::system_clock::now();
-        });
+        _stats.states_sent += pending.states_count;
+        _stats.states_removed += pending.removed_count;
+        deferred += pending.deferred;
     }
 
-    // Send clients game state
-    for (auto& client : _clients) {
+    _stats.states_deferred += deferred;
+    _states_deferred_total->add(deferred);
 
-        Server_update update_msg;
-        update_msg.states = _states;
+    const std::span<const Entity_state> states(storage->states);
+    const std::span<const std::size_t> removed(storage->removed);
 
-        // Only send the last input processed for this client, it doesn't care
-        // about the other clients
-        update_msg.last_processed_input = _last_processed_inputs[client->entity_id()];
+    // Transports accept concurrent sends for different clients, so encoding
+    // is spread across the pool too
+    _pool.parallel_for(
+      _clients.size(),
+      [this, &shared_storage, states, removed](std::size_t begin, std::size_t end) {
+          for (std::size_t index = begin; index < end; ++index) {
+              const auto& pending = _pending[index];
+              const auto entity_id = _clients[index].entity_id;
 
-        client->send(update_msg, _network_delay);
+              Server_update update_msg;
+              update_msg.storage = shared_storage;
+              update_msg.states =
+                states.subspan(pending.states_offset, pending.states_count);
+              update_msg.removed =
+                removed.subspan(pending.removed_offset, pending.removed_count);
+              update_msg.tick = _tick;
+              update_msg.baseline_tick = pending.baseline_tick;
+
+              // Only send the last input processed for this client, it doesn't
+              // care about the other clients
+              update_msg.last_processed_input =
+                _clients[index].last_processed_input;
+
+              if (_recorder != nullptr) {
+                  _recorder->update_sent(entity_id, update_msg);
+              }
+
+              _transport->send(entity_id, update_msg);
+          }
+      }
+    );
+
+    _transport->flush();
+
+    if (_recorder != nullptr) {
+        _recorder->tick(_tick, _tick_interval);
+    }
+
+    trace::record<trace::Event::tick_end>();
+    _tick_duration->record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start
+      )
+        .count()
+    ));
+}
+
+void Server::apply(const Inbound& inbound)
+{
+    const auto id = std::visit(
+      [](const auto& message) { return message.entity_id; }, inbound
+    );
+
+    // Sent before the client was disconnected, or never connected at all
+    auto* entity = _entities.find(id);
+    if (entity == nullptr || entity->client == no_client) {
+        return;
+    }
+
+    auto& connection = _clients[entity->client];
+
+    if (const auto* ack = std::get_if<Client_ack>(&inbound)) {
+        // Acks can arrive out of order, only ever move forward
+        connection.acked_tick = std::max(connection.acked_tick, ack->tick);
+        return;
+    }
+
+    const auto& batch = std::get<Input_batch>(inbound);
+
+    auto sequence_number = batch.first_sequence_number();
+    for (uint32_t i = 0; i < batch.count; ++i, ++sequence_number) {
+        // Already applied from an earlier batch
+        if (sequence_number <= connection.last_processed_input) {
+            continue;
+        }
+
+        const auto duration = batch.durations[i].count();
+        const auto before = entity->position;
+
+        entity->position = update_position(entity->position, duration);
+        entity->moved += entity->position - before;
+        connection.last_processed_input = sequence_number;
+
+        trace::record<trace::Event::server_input>(
+          id, sequence_number, duration, entity->position
+        );
+    }
+}
+
+void Server::prepare_update(
+  std::size_t index, const std::shared_ptr<const Update_storage>& storage
+)
+{
+    auto& client = _clients[index];
+    auto& pending = _pending[index];
+
+    pending.baseline_tick = 0;
+    pending.full_snapshot = false;
+    pending.deferred = 0;
+    pending.states.clear();
+    pending.removed.clear();
+
+    // Delta against the newest snapshot the client has acknowledged, as long
+    // as we still remember what we sent it. Looked up before storing this
+    // tick's snapshot, which may reuse the slot of one that has aged out.
+    const Snapshot* baseline = client.sent.find(client.acked_tick);
+    if (baseline != nullptr && _tick - baseline->tick >= snapshot_history_size) {
+        baseline = nullptr;
+    }
+
+    const Snapshot* previous = client.sent.find(_tick - 1);
+    auto& sent = client.sent.store(_tick);
+
+    std::span<const Entity_state> view(_states);
+
+    if (_interest.enabled()) {
+        select_relevant(
+          _spatial_index,
+          _states,
+          _entities.get(client.entity_id).position,
+          _interest,
+          previous != nullptr ? previous->states() : std::span<const Entity_state>(),
+          sent.owned
+        );
+        view = sent.owned;
+    }
+    else {
+        sent.shared = storage;
+        sent.shared_size = _states.size();
+    }
+
+    if (baseline != nullptr) {
+        pending.baseline_tick = baseline->tick;
+        diff(baseline->states(), view, pending.states, pending.removed);
+    }
+    else if (_interest.enabled()) {
+        pending.states.assign(view.begin(), view.end());
+    }
+    else {
+        pending.full_snapshot = true;
+    }
+
+    if (_budget.enabled()) {
+        apply_budget(index, baseline, view, sent);
+    }
+}
+
+void Server::apply_budget(
+  std::size_t index,
+  const Snapshot* baseline,
+  std::span<const Entity_state> view,
+  Snapshot& sent
+)
+{
+    auto& client = _clients[index];
+    auto& pending = _pending[index];
+
+    // A full snapshot's states are the view itself, pending.states is unused
+    if (!pending.full_snapshot) {
+        std::swap(pending.states, pending.candidates);
+    }
+    const std::span<const Entity_state> candidates = pending.full_snapshot
+      ? view
+      : std::span<const Entity_state>(pending.candidates);
+
+    const auto keep =
+      _wire_format.max_states(_budget.bytes, candidates, pending.removed);
+
+    if (keep >= candidates.size()) {
+        client.priorities.reset(candidates);
+        if (!pending.full_snapshot) {
+            std::swap(pending.states, pending.candidates);
+        }
+        return;
+    }
+
+    client.priorities.select(
+      candidates,
+      baseline != nullptr ? baseline->states() : std::span<const Entity_state>(),
+      client.entity_id,
+      _entities.get(client.entity_id).position,
+      _budget,
+      keep,
+      pending.states
+    );
+    pending.deferred = candidates.size() - pending.states.size();
+
+    // The client only ends up holding what made it in. Whatever was deferred
+    // still differs from that next tick, so it stays a candidate until sent.
+    if (baseline != nullptr) {
+        patch(baseline->states(), pending.states, pending.removed, sent.owned);
+    }
+    else {
+        sent.owned.assign(pending.states.begin(), pending.states.end());
     }
+    sent.shared.reset();
+    sent.shared_size = 0;
+    pending.full_snapshot = false;
 }
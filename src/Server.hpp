@@ -1,33 +1,268 @@
 #pragma once
 
-#include "Client.hpp"
+#include "Clock.hpp"
 #include "Command_message.hpp"
 #include "common.hpp"
+#include "Delay_queue.hpp"
+#include "Entity_registry.hpp"
+#include "Interest.hpp"
+#include "Metrics.hpp"
+#include "Mpsc_queue.hpp"
+#include "Priority_accumulator.hpp"
+#include "Recorder.hpp"
+#include "Server_update.hpp"
+#include "Snapshot.hpp"
+#include "Thread_pool.hpp"
+#include "Transport.hpp"
+#include "Wire_format.hpp"
 
-#include <mutex>
-#include <queue>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <variant>
 #include <vector>
 
 // TODO: docs
 
+struct Server_stats {
+    uint64_t full_snapshots{0};
+    uint64_t delta_snapshots{0};
+    uint64_t states_sent{0};
+    uint64_t states_removed{0};
+
+    // Changed entity states held back by the bandwidth budget, counted once
+    // for every tick they are held back
+    uint64_t states_deferred{0};
+
+    // Client messages lost because the inbound queue was full
+    uint64_t inbound_dropped{0};
+};
+
+/// @brief Client messages that can be handed to the server between two
+/// updates before it starts dropping them
+constexpr std::size_t server_inbound_capacity{8192};
+
 class Server {
-    struct Message {
-        Client_message message;
-        std::chrono::system_clock::time_point recv_timestamp;
+    using Inbound = std::variant<Input_batch, Client_ack>;
+
+    struct Connection {
+        std::size_t entity_id;
+
+        // Newest tick the client has reconstructed, 0 until it acknowledges one
+        uint32_t acked_tick{0};
+
+        // Sequence number of the newest input applied to the client's entity
+        uint32_t last_processed_input{0};
+
+        // What the client holds after each update sent to it, so acknowledged
+        // ticks can be used as delta baselines
+        Snapshot_history sent;
+
+        // Only used while the bandwidth budget is enabled
+        Priority_accumulator priorities;
+    };
+
+    static constexpr std::size_t no_client{std::numeric_limits<std::size_t>::max()};
+
+    struct Entity {
+        double position{0.0};
+
+        // How far the inputs applied this tick moved it, for its velocity
+        double moved{0.0};
+
+        // Index into _clients of the client controlling the entity, if any
+        std::size_t client{no_client};
     };
 
-    std::vector<Client*> _clients;
-    std::mutex _queue_mutex;
-    std::vector<Message> _queue;
-    std::chrono::milliseconds _network_delay;
+    Server_transport* _transport;
+    Clock const* _clock;
+
+    Entity_registry<Entity> _entities;
+
+    // Connected clients in no particular order, see Entity::client
+    std::vector<Connection> _clients;
+
+    // Handed over by send() on any thread, moved into _queue by update()
+    using Arrival = std::pair<Inbound, Clock::time_point>;
+    Mpsc_queue<Arrival> _inbound{server_inbound_capacity};
+    std::atomic<uint64_t> _inbound_dropped{0};
+
+    // Messages held back until their network delay has passed. Only touched by
+    // update(), so it needs no lock.
+    Delay_queue<Inbound> _queue;
+
+    // Messages popped from _queue this tick, kept to reuse its capacity
+    std::vector<Inbound> _due;
+
+    uint32_t _tick{0};
 
+    // Every entity as of this tick, sorted by id
     std::vector<Entity_state> _states;
-    std::vector<uint32_t> _last_processed_inputs;
+
+    // Each client's update this tick, indexed like _clients. Built in parallel
+    // into its own buffers, then copied into the tick's Update_storage in
+    // client order so the result doesn't depend on scheduling.
+    struct Pending_update {
+        uint32_t baseline_tick{0};
+
+        // The whole world, the leading states of the storage
+        bool full_snapshot{false};
+
+        std::vector<Entity_state> states;
+        std::vector<std::size_t> removed;
+
+        // States that didn't fit the budget this tick
+        std::size_t deferred{0};
+
+        // What the states were picked from when over budget, kept to reuse its
+        // capacity
+        std::vector<Entity_state> candidates;
+
+        // Where the update ends up in the tick's Update_storage
+        std::size_t states_offset{0};
+        std::size_t states_count{0};
+        std::size_t removed_offset{0};
+        std::size_t removed_count{0};
+    };
+
+    std::vector<Pending_update> _pending;
+
+    // Every tick's Update_storage, reused once clients are done with it
+    Update_storage_pool _storage_pool;
+
+    Thread_pool _pool;
+
+    // Indices into _due, sharded by entity so each entity's messages are
+    // applied in order by a single thread
+    std::vector<std::vector<std::size_t>> _shards;
+
+    Interest_config _interest;
+    Spatial_index _spatial_index;
+
+    Budget_config _budget;
+
+    // What updates are costed with against the budget
+    Wire_format _wire_format;
+
+    // Simulation time each tick covers, 0 while unknown
+    milliseconds_d _tick_interval{0.0};
+
+    Server_stats _stats;
+
+    // Registered once in the constructor, updated every tick
+    metrics::Histogram* _tick_duration;
+    metrics::Gauge* _inbound_depth;
+    metrics::Gauge* _delayed_depth;
+    metrics::Counter* _inbound_dropped_total;
+    metrics::Counter* _states_deferred_total;
+
+    Recorder* _recorder{nullptr};
 
 public:
-    explicit Server(std::chrono::milliseconds network_delay);
-    size_t connect(Client* client);
-    void send(Client_message const& msg, std::chrono::milliseconds delay);
+    /// @param threads Threads to run each tick's input and per-client phases
+    ///  on, including the one calling update()
+    /// @param clock What message delays are measured against, must outlive the
+    ///  server
+    explicit Server(
+      Server_transport& transport,
+      std::size_t threads = 1,
+      Clock const& clock = real_clock()
+    );
+
+    [[nodiscard]]
+    Clock const& clock() const
+    {
+        return *_clock;
+    }
+
+    /// @brief Spawns an entity for a new client
+    /// @return the id of the client's entity, which also identifies the client
+    /// @throws std::length_error if max_entities are already alive
+    size_t connect(double spawn_position = 0.0);
+
+    /// @brief Spawns an entity no client controls
+    /// @return its id
+    /// @throws std::length_error if max_entities are already alive
+    size_t spawn(double position);
+
+    /// @brief Removes an entity, disconnecting its client if it has one
+    ///
+    /// The client is detached from the transport, so updates stop going to it
+    /// even once the slot is reused. Messages still on their way from the client
+    /// are dropped on arrival, its id being stale.
+    /// @return false if the entity was already gone
+    bool despawn(std::size_t entity_id);
+
+    /// @brief Entities alive
+    [[nodiscard]]
+    std::size_t entity_count() const
+    {
+        return _entities.size();
+    }
+
+    /// @brief How much simulation time each update() covers
+    ///
+    /// Entity velocities are what the tick's inputs moved them by over this
+    /// interval. States carry no velocity until it is set.
+    void tick_interval(milliseconds_d interval) { _tick_interval = interval; }
+
+    /// @brief Limits each client's updates to entities near its own
+    void interest(Interest_config const& config) { _interest = config; }
+
+    /// @brief Limits the size of each client's updates, deferring the changes
+    /// that matter least to it when there are too many
+    ///
+    /// Entity states are costed with format's upper bound and only sent while
+    /// they fit in config.bytes. The budget is soft: removals and the client's
+    /// own entity are sent regardless, and can take an update over it.
+    void budget(Budget_config const& config, Wire_format format = Wire_format{})
+    {
+        _budget = config;
+        _wire_format = format;
+    }
+
+    /// @brief Records connections, the messages applied each tick and the
+    /// updates sent, until set back to nullptr
+    void recorder(Recorder* recorder) { _recorder = recorder; }
+
+    /// @brief Queues a batch of client inputs for processing once delay has
+    /// passed
+    ///
+    /// Inputs the server has already processed, repeats of earlier batches, are
+    /// skipped. Safe to call from any thread, and never blocks. Messages are
+    /// dropped if more than server_inbound_capacity arrive between two updates.
+    void send(Input_batch const& batch, std::chrono::microseconds delay);
+
+    /// @brief Queues a snapshot acknowledgement for processing once delay has
+    /// passed
+    void send(Client_ack const& ack, std::chrono::microseconds delay);
+
     void update();
-    void set_network_delay(std::chrono::milliseconds network_delay) { _network_delay = network_delay; }
+
+    [[nodiscard]]
+    Server_stats const& stats() const
+    {
+        return _stats;
+    }
+
+private:
+    void enqueue(Inbound inbound, std::chrono::microseconds delay);
+
+    void apply(Inbound const& inbound);
+
+    /// @brief Picks what client index is sent this tick, into _pending[index]
+    void prepare_update(
+      std::size_t index, std::shared_ptr<const Update_storage> const& storage
+    );
+
+    /// @brief Cuts _pending[index] down to the budget, see budget()
+    /// @param view every state the client should hold this tick
+    void apply_budget(
+      std::size_t index,
+      Snapshot const* baseline,
+      std::span<Entity_state const> view,
+      Snapshot& sent
+    );
 };
@@ -1,14 +1,45 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <vector>
 
 struct Entity_state {
     double position;
     size_t id;
+
+    // Units per second the inputs applied in the state's tick moved the entity
+    // at, 0 if there were none. Clients extrapolate remote entities along it.
+    double velocity{0.0};
 };
 
-struct Server_update {
+/// @brief Memory the spans of Server_updates point into
+///
+/// The server fills one per tick and shares it between every update it sends
+/// that tick, so fanning a snapshot out to clients copies no entity states per
+/// client. Immutable once the first update referencing it is sent.
+struct Update_storage {
     std::vector<Entity_state> states;
-    uint32_t last_processed_input;
-};
\ No newline at end of file
+    std::vector<std::size_t> removed;
+};
+
+struct Server_update {
+    // Keeps states and removed alive, shared with the tick's other updates
+    std::shared_ptr<const Update_storage> storage;
+
+    // For a delta, only the entities that changed since the baseline. Otherwise
+    // every entity.
+    std::span<const Entity_state> states;
+
+    // Ids of entities in the baseline the client should forget, sorted. Always
+    // empty for a full snapshot.
+    std::span<const std::size_t> removed;
+
+    uint32_t last_processed_input{0};
+
+    // Ticks start at 1, a baseline_tick of 0 means this is a full snapshot
+    uint32_t tick{0};
+    uint32_t baseline_tick{0};
+};
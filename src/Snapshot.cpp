@@ -0,0 +1,128 @@
+#include "Snapshot.hpp"
+
+#include "Entity_registry.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+const Snapshot* Snapshot_history::find(uint32_t tick) const
+{
+    const auto& slot = _slots[tick % snapshot_history_size];
+
+    if (tick == 0 || slot.tick != tick) {
+        return nullptr;
+    }
+
+    return &slot;
+}
+
+Snapshot& Snapshot_history::store(uint32_t tick)
+{
+    auto& slot = _slots[tick % snapshot_history_size];
+    slot.tick = tick;
+    slot.shared.reset();
+    slot.shared_size = 0;
+    slot.owned.clear();
+    return slot;
+}
+
+std::shared_ptr<Update_storage> Update_storage_pool::acquire()
+{
+    for (std::size_t i = 0; i < _storages.size(); ++i) {
+        const auto index = (_next + i) % _storages.size();
+        auto& storage = _storages[index];
+
+        // Only the pool holds it, so nobody else can take a new reference
+        if (storage.use_count() != 1) {
+            continue;
+        }
+
+        // Pairs with the release of the last reference elsewhere, so whoever
+        // read it is done before it is overwritten
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        storage->states.clear();
+        storage->removed.clear();
+        _next = index + 1;
+        return storage;
+    }
+
+    _next = 0;
+    return _storages.emplace_back(std::make_shared<Update_storage>());
+}
+
+bool changed(const Entity_state& lhs, const Entity_state& rhs)
+{
+    // Bitwise, so a position that was sent is never considered changed by
+    // rounding and the comparison doesn't trip -Wfloat-equal
+    return std::bit_cast<uint64_t>(lhs.position) !=
+      std::bit_cast<uint64_t>(rhs.position) ||
+      std::bit_cast<uint64_t>(lhs.velocity) !=
+      std::bit_cast<uint64_t>(rhs.velocity);
+}
+
+void diff(
+  std::span<const Entity_state> baseline,
+  std::span<const Entity_state> current,
+  std::vector<Entity_state>& changes,
+  std::vector<std::size_t>& removed
+)
+{
+    auto base = baseline.begin();
+
+    for (const auto& state : current) {
+        for (; base != baseline.end() && entity_before(base->id, state.id); ++base) {
+            removed.push_back(base->id);
+        }
+
+        if (base != baseline.end() && base->id == state.id) {
+            if (changed(*base, state)) {
+                changes.push_back(state);
+            }
+            ++base;
+        }
+        else {
+            changes.push_back(state);
+        }
+    }
+
+    for (; base != baseline.end(); ++base) {
+        removed.push_back(base->id);
+    }
+}
+
+void patch(
+  std::span<const Entity_state> baseline,
+  std::span<const Entity_state> changes,
+  std::span<const std::size_t> removed,
+  std::vector<Entity_state>& out
+)
+{
+    out.clear();
+    out.reserve(std::max(baseline.size(), changes.size()));
+
+    auto base = baseline.begin();
+    auto change = changes.begin();
+    auto remove = removed.begin();
+
+    while (base != baseline.end() || change != changes.end()) {
+        if (change == changes.end() ||
+            (base != baseline.end() && entity_before(base->id, change->id))) {
+            while (remove != removed.end() && entity_before(*remove, base->id)) {
+                ++remove;
+            }
+
+            if (remove == removed.end() || *remove != base->id) {
+                out.push_back(*base);
+            }
+            ++base;
+        }
+        else {
+            if (base != baseline.end() && base->id == change->id) {
+                ++base;
+            }
+            out.push_back(*change++);
+        }
+    }
+}
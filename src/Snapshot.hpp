@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Server_update.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// How many ticks back a delta's baseline may be. Older acknowledgements fall
+// back to a full snapshot.
+inline constexpr std::size_t snapshot_history_size{32};
+
+/// @brief Every entity state as of a tick, sorted by id
+///
+/// Either the leading shared_size states of a tick's shared Update_storage,
+/// when it is exactly what was fanned out to everyone, or a private copy.
+struct Snapshot {
+    uint32_t tick{0};
+
+    std::shared_ptr<const Update_storage> shared;
+    std::size_t shared_size{0};
+
+    std::vector<Entity_state> owned;
+
+    [[nodiscard]]
+    std::span<Entity_state const> states() const
+    {
+        if (shared) {
+            return std::span(shared->states).first(shared_size);
+        }
+        return owned;
+    }
+};
+
+/// @brief The last snapshot_history_size snapshots, looked up by tick
+///
+/// Slots are reused, so once warmed up storing a snapshot no longer allocates.
+class Snapshot_history {
+    std::array<Snapshot, snapshot_history_size> _slots;
+
+public:
+    /// @return the snapshot for tick, or nullptr if it was never stored or has
+    ///   been overwritten
+    [[nodiscard]]
+    const Snapshot* find(uint32_t tick) const;
+
+    /// @brief Claims the slot for tick, evicting whatever was there
+    Snapshot& store(uint32_t tick);
+};
+
+/// @brief Recycles Update_storages once nothing refers to them any more
+///
+/// The server needs a fresh storage every tick, while delay queues and snapshot
+/// histories hold on to those of recent ticks for a while. Handing out released
+/// ones again, vectors and all, means building a tick's updates stops
+/// allocating once the pool holds as many storages as there are ticks in
+/// flight.
+///
+/// Not thread-safe, though the storages handed out may be released on any
+/// thread.
+class Update_storage_pool {
+    std::vector<std::shared_ptr<Update_storage>> _storages;
+
+    // Where to start looking, storages tend to be released oldest first
+    std::size_t _next{0};
+
+public:
+    /// @brief An empty storage, with the capacity it had when last used
+    [[nodiscard]]
+    std::shared_ptr<Update_storage> acquire();
+
+    /// @brief Storages allocated so far, in use or not
+    [[nodiscard]]
+    std::size_t size() const
+    {
+        return _storages.size();
+    }
+};
+
+[[nodiscard]]
+bool changed(Entity_state const& lhs, Entity_state const& rhs);
+
+/// @brief Appends every state in current that is new or differs from baseline
+/// to changes, and the id of every state only in baseline to removed
+/// @pre both are sorted by id
+void diff(
+  std::span<Entity_state const> baseline,
+  std::span<Entity_state const> current,
+  std::vector<Entity_state>& changes,
+  std::vector<std::size_t>& removed
+);
+
+/// @brief Writes baseline with changes and removals applied into out, replacing
+/// its contents
+/// @pre all are sorted by id
+void patch(
+  std::span<Entity_state const> baseline,
+  std::span<Entity_state const> changes,
+  std::span<std::size_t const> removed,
+  std::vector<Entity_state>& out
+);
@@ -0,0 +1,151 @@
+#include "Thread_pool.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+
+Thread_pool::Thread_pool(std::size_t threads)
+{
+    threads = std::max<std::size_t>(threads, 1);
+
+    _queues.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        _queues.push_back(std::make_unique<Queue>());
+
+        // parallel_for() deals out at most this many chunks per queue
+        _queues.back()->chunks.reserve(chunks_per_thread);
+    }
+
+    _workers.reserve(threads - 1);
+    for (std::size_t i = 1; i < threads; ++i) {
+        _workers.emplace_back([this, i] { work(i); });
+    }
+}
+
+Thread_pool::~Thread_pool()
+{
+    {
+        const std::scoped_lock lock(_wake_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+
+    _workers.clear();
+}
+
+void Thread_pool::run(std::size_t count, Body body)
+{
+    if (count == 0) {
+        return;
+    }
+
+    if (size() == 1 || count == 1) {
+        body.call(body.context, 0, count);
+        return;
+    }
+
+    const std::size_t chunks = std::min(count, size() * chunks_per_thread);
+
+    _body = body;
+    _error = nullptr;
+    _remaining.store(chunks, std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < chunks; ++i) {
+        auto& queue = *_queues[i % size()];
+        const std::scoped_lock lock(queue.mutex);
+        queue.chunks.push_back(
+          Chunk{.begin = count * i / chunks, .end = count * (i + 1) / chunks}
+        );
+    }
+
+    {
+        const std::scoped_lock lock(_wake_mutex);
+        ++_generation;
+    }
+    _wake.notify_all();
+
+    while (run_one(0)) {
+    }
+
+    // Every chunk has been taken, wait for the ones still running elsewhere
+    while (_remaining.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+
+    _body = {};
+
+    if (_error) {
+        std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+}
+
+void Thread_pool::work(std::size_t index)
+{
+    uint64_t seen{0};
+
+    for (;;) {
+        {
+            std::unique_lock lock(_wake_mutex);
+            _wake.wait(lock, [this, seen] {
+                return _stopping || _generation != seen;
+            });
+
+            if (_stopping) {
+                return;
+            }
+
+            seen = _generation;
+        }
+
+        while (run_one(index)) {
+        }
+    }
+}
+
+bool Thread_pool::run_one(std::size_t index)
+{
+    std::optional<Chunk> chunk;
+
+    // Newest of our own first, it is the most likely to still be in cache
+    {
+        auto& queue = *_queues[index];
+        const std::scoped_lock lock(queue.mutex);
+        if (queue.front != queue.chunks.size()) {
+            chunk = queue.chunks.back();
+            queue.chunks.pop_back();
+        }
+        if (queue.front == queue.chunks.size()) {
+            queue.chunks.clear();
+            queue.front = 0;
+        }
+    }
+
+    for (std::size_t offset = 1; !chunk && offset < size(); ++offset) {
+        auto& queue = *_queues[(index + offset) % size()];
+        const std::scoped_lock lock(queue.mutex);
+        if (queue.front != queue.chunks.size()) {
+            chunk = queue.chunks[queue.front++];
+        }
+        if (queue.front == queue.chunks.size()) {
+            queue.chunks.clear();
+            queue.front = 0;
+        }
+    }
+
+    if (!chunk) {
+        return false;
+    }
+
+    try {
+        _body.call(_body.context, chunk->begin, chunk->end);
+    }
+    catch (...) {
+        const std::scoped_lock lock(_error_mutex);
+        if (!_error) {
+            _error = std::current_exception();
+        }
+    }
+
+    _remaining.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief Fork-join pool whose threads steal each other's work
+///
+/// parallel_for() splits an index range into chunks dealt round-robin to one
+/// deque per thread. Each thread pops its own chunks from the back and, once it
+/// runs dry, steals from the front of the others', so uneven chunks even out.
+/// The calling thread works too, and only returns once every chunk has run,
+/// which makes each call a merge point.
+///
+/// Nothing is allocated per call: bodies are referenced rather than copied
+/// into a std::function, and chunks go into queues reserved up front.
+class Thread_pool {
+public:
+    /// @param threads Threads working on each call, including the caller. With
+    ///  1, everything runs on the caller and no threads are started.
+    explicit Thread_pool(std::size_t threads);
+
+    ~Thread_pool();
+
+    DISABLE_COPY(Thread_pool);
+    DISABLE_MOVE(Thread_pool);
+
+    [[nodiscard]]
+    std::size_t size() const
+    {
+        return _queues.size();
+    }
+
+    /// @brief Runs body(begin, end) over [0, count) in chunks and waits for all
+    /// of them
+    /// @throws whatever the first failing chunk threw, once every chunk is done
+    /// @pre Not called concurrently, nor from inside a body
+    template <typename F>
+    void parallel_for(std::size_t count, F const& body)
+    {
+        run(
+          count,
+          Body{
+            .context = &body,
+            .call =
+              [](const void* context, std::size_t begin, std::size_t end) {
+                  (*static_cast<F const*>(context))(begin, end);
+              }}
+        );
+    }
+
+private:
+    // The caller's body, only referenced for the duration of run()
+    struct Body {
+        const void* context;
+        void (*call)(const void* context, std::size_t begin, std::size_t end);
+    };
+
+    // Enough chunks for stealing to balance uneven work, few enough that
+    // taking them stays cheap
+    static constexpr std::size_t chunks_per_thread{4};
+
+    struct Chunk {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        // Taken from the back by the owner, from the front by thieves
+        std::vector<Chunk> chunks;
+        std::size_t front{0};
+    };
+
+    // One per thread, the caller's first
+    std::vector<std::unique_ptr<Queue>> _queues;
+
+    std::mutex _wake_mutex;
+    std::condition_variable _wake;
+    uint64_t _generation{0};
+    bool _stopping{false};
+
+    Body _body{};
+    std::atomic<std::size_t> _remaining{0};
+
+    std::mutex _error_mutex;
+    std::exception_ptr _error;
+
+    // Last, so the threads are joined before anything they use is destroyed
+    std::vector<std::jthread> _workers;
+
+    void run(std::size_t count, Body body);
+
+    void work(std::size_t index);
+
+    /// @brief Runs one chunk, the thread's own or a stolen one
+    /// @return false if there was nothing left to run
+    bool run_one(std::size_t index);
+};
@@ -0,0 +1,62 @@
+#include "Tick_scheduler.hpp"
+
+#include <algorithm>
+#include <thread>
+
+Tick_scheduler::Tick_scheduler(clock::duration interval, uint64_t max_catch_up)
+  : _interval(interval),
+    _max_catch_up(max_catch_up),
+    _deadline(clock::now()),
+    _lateness(&metrics::registry().histogram(
+      "netcode_tick_lateness_seconds",
+      "How long after its deadline each tick started",
+      1e-9
+    )),
+    _overruns(&metrics::registry().counter(
+      "netcode_tick_overruns_total",
+      "Ticks that started an interval or more after their deadline"
+    )),
+    _skipped(&metrics::registry().counter(
+      "netcode_tick_skipped_total",
+      "Deadlines given up on after falling too far behind"
+    ))
+{}
+
+uint64_t Tick_scheduler::wait()
+{
+    auto now = clock::now();
+
+    if (now < _deadline - spin_threshold) {
+        std::this_thread::sleep_until(_deadline - spin_threshold);
+    }
+
+    while ((now = clock::now()) < _deadline) {
+        std::this_thread::yield();
+    }
+
+    const auto lateness =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - _deadline);
+    const auto intervals_late =
+      _interval.count() > 0 ? static_cast<uint64_t>(lateness / _interval) : 0;
+
+    ++_stats.ticks;
+    _stats.total_lateness += lateness;
+    _stats.max_lateness = std::max(_stats.max_lateness, lateness);
+    _lateness->record(static_cast<uint64_t>(lateness.count()));
+
+    if (intervals_late > 0) {
+        ++_stats.overruns;
+        _overruns->add();
+    }
+
+    if (intervals_late > _max_catch_up) {
+        // Stay on the original grid rather than restarting it from now
+        _stats.skipped += intervals_late;
+        _skipped->add(intervals_late);
+        _tick += intervals_late;
+        _deadline += static_cast<clock::rep>(intervals_late) * _interval;
+    }
+
+    _deadline += _interval;
+    return ++_tick;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Metrics.hpp"
+
+#include <chrono>
+#include <cstdint>
+
+struct Tick_scheduler_stats {
+    uint64_t ticks{0};
+
+    // Ticks that started an interval or more after their deadline, because the
+    // work before them ran long
+    uint64_t overruns{0};
+
+    // Deadlines given up on after falling too far behind to catch up
+    uint64_t skipped{0};
+
+    // How long after its deadline each tick started
+    std::chrono::nanoseconds total_lateness{0};
+    std::chrono::nanoseconds max_lateness{0};
+};
+
+/// @brief Paces a fixed-timestep loop against absolute deadlines
+///
+/// Deadlines are start + n * interval on steady_clock, so neither the work
+/// done each tick nor sleep overshoot accumulates into drift. The wait sleeps
+/// until shortly before the deadline and spins the rest of the way, since
+/// sleeps routinely overshoot by more than a high tick rate can absorb.
+///
+/// A late tick runs immediately and the following ones back to back until
+/// caught up. Falling more than max_catch_up intervals behind skips the missed
+/// deadlines instead, rather than bursting through all of them.
+class Tick_scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /// @param interval Time between ticks
+    /// @param max_catch_up Most deadlines run back to back after a stall
+    explicit Tick_scheduler(clock::duration interval, uint64_t max_catch_up = 5);
+
+    /// @brief Blocks until the next tick is due
+    /// @return the number of the tick, starting at 1. Skipped deadlines use up
+    ///  their numbers, so ticks stay aligned with elapsed time.
+    uint64_t wait();
+
+    /// @brief Changes the tick rate from the next deadline on
+    void interval(clock::duration interval) { _interval = interval; }
+
+    [[nodiscard]]
+    clock::duration interval() const
+    {
+        return _interval;
+    }
+
+    [[nodiscard]]
+    Tick_scheduler_stats const& stats() const
+    {
+        return _stats;
+    }
+
+private:
+    // Sleeps are trusted up to this close to the deadline, spun the rest
+    static constexpr auto spin_threshold = std::chrono::milliseconds{1};
+
+    clock::duration _interval;
+    uint64_t _max_catch_up;
+    clock::time_point _deadline;
+    uint64_t _tick{0};
+    Tick_scheduler_stats _stats;
+
+    metrics::Histogram* _lateness;
+    metrics::Counter* _overruns;
+    metrics::Counter* _skipped;
+};
@@ -0,0 +1,144 @@
+#include "Trace.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace trace {
+
+namespace {
+
+struct Record {
+    int64_t timestamp_ns;
+    Event event;
+    std::array<double, max_args> args;
+};
+
+struct Buffer {
+    explicit Buffer(uint32_t id)
+      : thread_id(id),
+        records(buffer_capacity)
+    {}
+
+    uint32_t thread_id;
+    std::vector<Record> records;
+
+    // Total records ever written, the next one goes to written % capacity
+    uint64_t written{0};
+};
+
+// Buffers outlive their threads, so a trace can be exported after the threads
+// it covers have exited
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+
+    Buffer& add()
+    {
+        const std::scoped_lock lock(mutex);
+        const auto id = static_cast<uint32_t>(buffers.size());
+        return *buffers.emplace_back(std::make_unique<Buffer>(id));
+    }
+};
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+Buffer& thread_buffer()
+{
+    thread_local Buffer& buffer = registry().add();
+    return buffer;
+}
+
+// JSON has no NaN or infinity, they're written as the strings JavaScript
+// would print them as so the file still parses
+void write_number(std::ostream& out, double value)
+{
+    if (std::isnan(value)) {
+        out << "\"NaN\"";
+    }
+    else if (std::isinf(value)) {
+        out << (value > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+    }
+    else {
+        out << value;
+    }
+}
+
+}  // namespace
+
+void detail::record(Event event, const std::array<double, max_args>& args)
+{
+    auto& buffer = thread_buffer();
+
+    auto& record = buffer.records[buffer.written % buffer.records.size()];
+    record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()
+    )
+                            .count();
+    record.event = event;
+    record.args = args;
+
+    ++buffer.written;
+}
+
+void write_chrome_json(std::ostream& out)
+{
+    auto& instance = registry();
+    const std::scoped_lock lock(instance.mutex);
+
+    // Enough digits for nanosecond timestamps and large ids
+    const auto precision = out.precision(15);
+
+    out << "{\"traceEvents\":[";
+
+    bool first{true};
+    for (const auto& buffer : instance.buffers) {
+        const uint64_t capacity = buffer->records.size();
+        const uint64_t begin =
+          buffer->written > capacity ? buffer->written - capacity : 0;
+
+        for (uint64_t i = begin; i < buffer->written; ++i) {
+            const auto& record = buffer->records[i % capacity];
+            const auto event_info = info(record.event);
+
+            out << (first ? "\n" : ",\n");
+            first = false;
+
+            // Chrome trace timestamps are microseconds
+            out << "{\"name\":\"" << event_info.name << "\",\"ph\":\""
+                << event_info.phase << "\",\"ts\":"
+                << static_cast<double>(record.timestamp_ns) / 1000.0
+                << ",\"pid\":1,\"tid\":" << buffer->thread_id;
+
+            if (event_info.phase == 'i') {
+                out << ",\"s\":\"t\"";
+            }
+
+            out << ",\"args\":{";
+            bool first_arg{true};
+            for (std::size_t arg = 0; arg < max_args; ++arg) {
+                if (event_info.args[arg] == nullptr) {
+                    continue;
+                }
+
+                out << (first_arg ? "" : ",") << '"' << event_info.args[arg]
+                    << "\":";
+                write_number(out, record.args[arg]);
+                first_arg = false;
+            }
+            out << "}}";
+        }
+    }
+
+    out << "\n]}\n";
+    out.precision(precision);
+}
+
+}  // namespace trace
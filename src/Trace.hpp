@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+// Bitmask of the trace::Category values compiled in. Events of any other
+// category compile to nothing.
+#ifndef NETCODE_TRACE_CATEGORIES
+#define NETCODE_TRACE_CATEGORIES 0xFFFFFFFFU
+#endif
+
+/// @brief Binary event tracing for the hot paths
+///
+/// trace::record() appends a fixed-size record, a timestamp, an event id and a
+/// few numeric arguments, to a ring buffer owned by the calling thread. Nothing
+/// is formatted and no lock is taken; once a ring is full its oldest records
+/// are overwritten. write_chrome_json() turns the records into a trace for
+/// chrome://tracing or Perfetto afterwards.
+namespace trace {
+
+enum class Category : uint32_t {
+    tick = 1U << 0U,
+    server = 1U << 1U,
+    client = 1U << 2U,
+};
+
+enum class Event : uint16_t {
+    tick_begin,
+    tick_end,
+    server_input,
+    client_update,
+    client_state,
+    client_replay,
+};
+
+constexpr std::size_t max_args{4};
+
+struct Event_info {
+    const char* name;
+    Category category;
+
+    // Chrome trace phase: 'B' and 'E' open and close a span, 'i' is an instant
+    char phase;
+
+    // Names of the arguments used, nullptr for the unused ones
+    std::array<const char*, max_args> args;
+};
+
+constexpr Event_info info(Event event)
+{
+    switch (event) {
+    case Event::tick_begin:
+        return {"server tick", Category::tick, 'B', {"tick"}};
+    case Event::tick_end:
+        return {"server tick", Category::tick, 'E', {}};
+    case Event::server_input:
+        return {
+          "server input",
+          Category::server,
+          'i',
+          {"entity", "sequence", "duration", "position"}};
+    case Event::client_update:
+        return {
+          "client update",
+          Category::client,
+          'i',
+          {"client", "tick", "baseline", "last input"}};
+    case Event::client_state:
+        return {
+          "client state",
+          Category::client,
+          'i',
+          {"client", "entity", "position"}};
+    case Event::client_replay:
+        return {
+          "client replay", Category::client, 'i', {"first", "last", "from"}};
+    }
+
+    return {"unknown", Category::tick, 'i', {}};
+}
+
+constexpr bool enabled(Category category)
+{
+    return (NETCODE_TRACE_CATEGORIES & static_cast<uint32_t>(category)) != 0;
+}
+
+/// @brief Records kept per thread before the oldest are overwritten
+constexpr std::size_t buffer_capacity{1U << 16U};
+
+namespace detail {
+
+// Integer arguments are exact up to 2^53, more than ids and ticks need
+void record(Event event, std::array<double, max_args> const& args);
+
+constexpr double to_arg(double value)
+{
+    return value;
+}
+
+template <typename T>
+constexpr double to_arg(T value)
+{
+    return static_cast<double>(value);
+}
+
+}  // namespace detail
+
+/// @brief Records event on the calling thread, if its category is compiled in
+template <Event E, typename... Args>
+inline void record(Args... args)
+{
+    static_assert(sizeof...(Args) <= max_args);
+
+    if constexpr (enabled(info(E).category)) {
+        detail::record(E, {detail::to_arg(args)...});
+    }
+}
+
+/// @brief Writes every thread's records as Chrome trace event JSON
+///
+/// Only call while the traced threads are idle, e.g. once they have stopped;
+/// the rings are read without synchronizing with their writers.
+void write_chrome_json(std::ostream& out);
+
+}  // namespace trace
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Command_message.hpp"
+#include "Entity_registry.hpp"
+#include "Metrics.hpp"
+#include "Server_update.hpp"
+
+#include <cstddef>
+
+class Client;
+class Server;
+
+/// @brief Server end of the link between a Server and its clients
+///
+/// Backends are free to buffer outgoing updates until flush() so that a whole
+/// tick's worth of updates can be handed to the OS at once.
+class Server_transport {
+public:
+    virtual ~Server_transport() = default;
+
+    /// @brief Queues an update for the client that owns entity_id
+    ///
+    /// The server calls this from its worker threads, concurrently for
+    /// different entity_ids but never for the same one. flush() and poll() are
+    /// only called from the thread running Server::update().
+    virtual void send(std::size_t entity_id, Server_update const& update) = 0;
+
+    /// @brief Pushes every queued update onto the wire
+    virtual void flush() = 0;
+
+    /// @brief Hands every client message that has arrived to the server
+    virtual void poll(Server& server) = 0;
+
+    /// @brief Forgets the client that owned entity_id, called by the server
+    /// once the entity is despawned, never while updates are being sent
+    virtual void detach(std::size_t /*entity_id*/) {}
+};
+
+/// @brief Traffic a server transport sends to one client, for the metrics
+/// registry
+///
+/// Series are labelled with the slot of the client's entity rather than its
+/// id. Slots are reused once entities despawn, so the series are too, and the
+/// registry only grows with the most clients connected at once.
+struct Client_traffic {
+    metrics::Counter* messages{nullptr};
+    metrics::Counter* bytes{nullptr};
+
+    explicit Client_traffic(std::size_t entity_id)
+    {
+        const auto labels = metrics::label("client", entity_index(entity_id));
+        messages = &metrics::registry().counter(
+          "netcode_server_sent_messages_total", "Updates sent to a client", labels
+        );
+        bytes = &metrics::registry().counter(
+          "netcode_server_sent_bytes_total",
+          "Encoded size of the updates sent to a client",
+          labels
+        );
+    }
+
+    void record(std::size_t size)
+    {
+        messages->add();
+        bytes->add(size);
+    }
+};
+
+/// @brief Client end of the link between a Client and the server
+class Client_transport {
+public:
+    virtual ~Client_transport() = default;
+
+    /// @brief Queues an input for the server, sent batched with the inputs
+    /// before it on the next flush()
+    virtual void send(Client_message const& msg) = 0;
+
+    /// @brief Queues a snapshot acknowledgement for the server
+    virtual void send(Client_ack const& ack) = 0;
+
+    /// @brief Pushes every queued message onto the wire, called once per
+    /// network tick
+    virtual void flush() = 0;
+
+    /// @brief Hands every server update that has arrived to the client
+    virtual void poll(Client& client) = 0;
+};
@@ -0,0 +1,571 @@
+#include "Udp_transport.hpp"
+
+#include "Client.hpp"
+#include "Entity_registry.hpp"
+#include "Server.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Largest payload of a single IPv4 UDP datagram
+constexpr std::size_t max_datagram_size{65507};
+constexpr int socket_buffer_size{4 * 1024 * 1024};
+
+// The server only receives small input packets but many of them per tick,
+// clients receive few but large updates
+constexpr std::size_t server_receive_batch{64};
+constexpr std::size_t max_input_size{512};
+constexpr std::size_t client_receive_batch{4};
+enum class Packet_type : uint8_t {
+    connect,
+    accept,
+    input,
+    ack,
+    update,
+};
+
+[[noreturn]]
+void throw_errno(const char* what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+uint64_t address_key(const sockaddr_in& address)
+{
+    return (uint64_t{ntohl(address.sin_addr.s_addr)} << 16U) |
+      ntohs(address.sin_port);
+}
+
+// Appends a datagram that is nothing but its type
+void append_datagram(
+  std::vector<std::byte>& buffer,
+  std::vector<detail::Udp_socket::Datagram>& datagrams,
+  const sockaddr_in& address,
+  Packet_type type
+)
+{
+    datagrams.push_back({.address = address, .offset = buffer.size(), .size = 1});
+    buffer.push_back(static_cast<std::byte>(type));
+}
+
+// Every other datagram is a one byte Packet_type followed by the Wire_format
+// encoding of the message. max_size bounds the encoded message, encode writes
+// it into the span it is given.
+// @return false, appending nothing, if the message couldn't be encoded or
+//   doesn't fit in a datagram, which only updates can grow large enough for
+template <typename Encode>
+bool append_datagram(
+  std::vector<std::byte>& buffer,
+  std::vector<detail::Udp_socket::Datagram>& datagrams,
+  const sockaddr_in& address,
+  Packet_type type,
+  std::size_t max_size,
+  Encode&& encode
+)
+{
+    const auto offset = buffer.size();
+    buffer.resize(offset + 1 + max_size);
+    buffer[offset] = static_cast<std::byte>(type);
+
+    const std::size_t size =
+      encode(std::span<std::byte>(buffer).subspan(offset + 1, max_size));
+
+    if (size == 0 || 1 + size > max_datagram_size) {
+        buffer.resize(offset);
+        return false;
+    }
+
+    buffer.resize(offset + 1 + size);
+    datagrams.push_back({.address = address, .offset = offset, .size = 1 + size});
+    return true;
+}
+
+}  // namespace
+
+namespace detail {
+
+Udp_socket::Udp_socket(
+  uint16_t port, std::size_t receive_batch, std::size_t max_receive_size
+)
+  : _receive_batch(receive_batch),
+    _max_receive_size(max_receive_size),
+    _receive_buffer(receive_batch * max_receive_size),
+    _receive_iovecs(receive_batch),
+    _receive_headers(receive_batch),
+    _receive_addresses(receive_batch)
+{
+    _fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        throw_errno("socket");
+    }
+
+    // Larger kernel buffers so a full tick of updates fits without EAGAIN.
+    // Failure only means we keep the system default.
+    ::setsockopt(
+      _fd, SOL_SOCKET, SO_SNDBUF, &socket_buffer_size, sizeof(socket_buffer_size)
+    );
+    ::setsockopt(
+      _fd, SOL_SOCKET, SO_RCVBUF, &socket_buffer_size, sizeof(socket_buffer_size)
+    );
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (::bind(_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        const auto error = errno;
+        ::close(_fd);
+        throw std::system_error(error, std::generic_category(), "bind");
+    }
+
+    _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll_fd < 0) {
+        const auto error = errno;
+        ::close(_fd);
+        throw std::system_error(error, std::generic_category(), "epoll_create1");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = _fd;
+
+    if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _fd, &event) < 0) {
+        const auto error = errno;
+        ::close(_epoll_fd);
+        ::close(_fd);
+        throw std::system_error(error, std::generic_category(), "epoll_ctl");
+    }
+}
+
+Udp_socket::~Udp_socket()
+{
+    ::close(_epoll_fd);
+    ::close(_fd);
+}
+
+uint16_t Udp_socket::port() const
+{
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    ::getsockname(_fd, reinterpret_cast<sockaddr*>(&address), &length);
+    return ntohs(address.sin_port);
+}
+
+std::size_t
+Udp_socket::send(std::span<const std::byte> buffer, std::span<Datagram> datagrams)
+{
+    auto& iovecs = _send_iovecs;
+    auto& headers = _send_headers;
+    iovecs.assign(datagrams.size(), iovec{});
+    headers.assign(datagrams.size(), mmsghdr{});
+
+    for (std::size_t i = 0; i < datagrams.size(); ++i) {
+        // sendmmsg only reads from the buffer, the iovec type just isn't const
+        iovecs[i].iov_base =
+          const_cast<std::byte*>(buffer.data() + datagrams[i].offset);
+        iovecs[i].iov_len = datagrams[i].size;
+
+        auto& header = headers[i].msg_hdr;
+        header.msg_name = &datagrams[i].address;
+        header.msg_namelen = sizeof(sockaddr_in);
+        header.msg_iov = &iovecs[i];
+        header.msg_iovlen = 1;
+    }
+
+    std::size_t sent{0};
+    while (sent < headers.size()) {
+        const auto remaining = static_cast<unsigned int>(headers.size() - sent);
+        const int ret = ::sendmmsg(_fd, headers.data() + sent, remaining, 0);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // UDP makes no delivery promises, so a full send buffer just drops
+            // the rest of this batch.
+            spdlog::warn(
+              "[udp] sendmmsg dropped {} datagrams: {}",
+              headers.size() - sent,
+              std::strerror(errno)
+            );
+            break;
+        }
+
+        sent += static_cast<std::size_t>(ret);
+    }
+
+    return sent;
+}
+
+std::size_t Udp_socket::receive(const Receive_callback& callback)
+{
+    epoll_event event{};
+    if (::epoll_wait(_epoll_fd, &event, 1, 0) <= 0) {
+        return 0;
+    }
+
+    auto& iovecs = _receive_iovecs;
+    auto& headers = _receive_headers;
+    auto& addresses = _receive_addresses;
+
+    std::size_t received{0};
+
+    while (true) {
+        for (std::size_t i = 0; i < _receive_batch; ++i) {
+            iovecs[i].iov_base = _receive_buffer.data() + i * _max_receive_size;
+            iovecs[i].iov_len = _max_receive_size;
+
+            auto& header = headers[i].msg_hdr;
+            header = {};
+            header.msg_name = &addresses[i];
+            header.msg_namelen = sizeof(sockaddr_in);
+            header.msg_iov = &iovecs[i];
+            header.msg_iovlen = 1;
+        }
+
+        const int ret = ::recvmmsg(
+          _fd,
+          headers.data(),
+          static_cast<unsigned int>(_receive_batch),
+          MSG_DONTWAIT,
+          nullptr
+        );
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // EWOULDBLOCK is EAGAIN on Linux
+            if (errno != EAGAIN) {
+                spdlog::error("[udp] recvmmsg: {}", std::strerror(errno));
+            }
+            break;
+        }
+
+        const auto count = static_cast<std::size_t>(ret);
+        for (std::size_t i = 0; i < count; ++i) {
+            if ((headers[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+                spdlog::warn("[udp] dropping truncated datagram");
+                continue;
+            }
+
+            callback(
+              addresses[i],
+              std::span<const std::byte>(
+                _receive_buffer.data() + i * _max_receive_size, headers[i].msg_len
+              )
+            );
+        }
+
+        received += count;
+
+        if (count < _receive_batch) {
+            break;
+        }
+    }
+
+    return received;
+}
+
+}  // namespace detail
+
+Udp_server_transport::Udp_server_transport(uint16_t port, Wire_format format)
+  : _socket(port, server_receive_batch, max_input_size),
+    _format(format),
+    _updates_dropped(&metrics::registry().counter(
+      "netcode_server_updates_dropped_total",
+      "Updates too large for a UDP datagram, which were never sent"
+    ))
+{}
+
+void Udp_server_transport::send(std::size_t entity_id, const Server_update& update)
+{
+    const auto index = entity_index(entity_id);
+    if (index >= _peers.size() || _peers[index].id != entity_id) {
+        return;
+    }
+
+    auto& peer = _peers[index];
+    const auto size = peer.buffer.size();
+    const bool appended = append_datagram(
+      peer.buffer,
+      peer.datagrams,
+      peer.address,
+      Packet_type::update,
+      _format.max_size(update),
+      [this, &update](std::span<std::byte> out) {
+          return _format.encode(update, out);
+      }
+    );
+
+    // Likely to happen again every tick until the client's view shrinks, so
+    // it's logged once per peer and counted
+    if (!appended) {
+        _updates_dropped->add();
+        if (!peer.dropped_logged) {
+            peer.dropped_logged = true;
+            spdlog::warn(
+              "[udp] dropping updates to client {} that don't fit in {} bytes, "
+              "set a --budget to bound them",
+              entity_index(entity_id),
+              max_datagram_size
+            );
+        }
+        return;
+    }
+
+    if (peer.traffic) {
+        peer.traffic->record(peer.buffer.size() - size);
+    }
+}
+
+void Udp_server_transport::flush()
+{
+    for (auto& peer : _peers) {
+        for (auto datagram : peer.datagrams) {
+            datagram.offset += _send_buffer.size();
+            _datagrams.push_back(datagram);
+        }
+        _send_buffer.insert(
+          _send_buffer.end(), peer.buffer.begin(), peer.buffer.end()
+        );
+
+        peer.buffer.clear();
+        peer.datagrams.clear();
+    }
+
+    _socket.send(_send_buffer, _datagrams);
+    _send_buffer.clear();
+    _datagrams.clear();
+}
+
+void Udp_server_transport::poll(Server& server)
+{
+    _socket.receive([this, &server](
+                      const sockaddr_in& address, std::span<const std::byte> data
+                    ) {
+        if (data.empty()) {
+            return;
+        }
+
+        const auto type = static_cast<Packet_type>(data.front());
+        const auto payload = data.subspan(1);
+
+        const auto key = address_key(address);
+        const auto peer = _entity_ids.find(key);
+
+        if (type == Packet_type::connect) {
+            std::size_t entity_id{0};
+
+            // Connect requests are resent until answered, so only the first one
+            // spawns an entity
+            if (peer == _entity_ids.end()) {
+                // A full server ignores new peers, which keep asking until
+                // someone leaves
+                try {
+                    entity_id = server.connect(
+                      _spawn_position ? _spawn_position(_connected) : 0.0
+                    );
+                }
+                catch (const std::length_error&) {
+                    if (!_refusing) {
+                        _refusing = true;
+                        spdlog::warn(
+                          "[udp] refusing new clients, {} entities are alive",
+                          max_entities
+                        );
+                    }
+                    return;
+                }
+                _refusing = false;
+                ++_connected;
+                _entity_ids.emplace(key, entity_id);
+
+                const auto index = entity_index(entity_id);
+                if (index + 1 > _peers.size()) {
+                    _peers.resize(index + 1);
+                }
+                _peers[index].id = entity_id;
+                _peers[index].address = address;
+                _peers[index].dropped_logged = false;
+                _peers[index].traffic.emplace(entity_id);
+            }
+            else {
+                entity_id = peer->second;
+            }
+
+            // Reuses the ack encoding, the tick is unused
+            const Client_ack accept{.entity_id = entity_id, .tick = 0};
+            append_datagram(
+              _send_buffer,
+              _datagrams,
+              address,
+              Packet_type::accept,
+              _format.max_client_message_size(),
+              [this, &accept](std::span<std::byte> out) {
+                  return _format.encode(accept, out);
+              }
+            );
+            return;
+        }
+
+        if (peer == _entity_ids.end()) {
+            return;
+        }
+
+        // The sender's address decides which entity a packet is for, not the id
+        // it claims
+        if (type == Packet_type::ack) {
+            Client_ack ack{};
+            if (_format.decode(payload, ack)) {
+                ack.entity_id = peer->second;
+                server.send(ack, 0ms);
+            }
+            return;
+        }
+
+        if (type == Packet_type::input) {
+            Input_batch batch{};
+            if (_format.decode(payload, batch)) {
+                batch.entity_id = peer->second;
+                server.send(batch, 0ms);
+            }
+        }
+    });
+}
+
+void Udp_server_transport::detach(std::size_t entity_id)
+{
+    const auto index = entity_index(entity_id);
+    if (index >= _peers.size() || _peers[index].id != entity_id) {
+        return;
+    }
+
+    auto& peer = _peers[index];
+    _entity_ids.erase(address_key(peer.address));
+    peer.id = no_entity;
+    peer.traffic.reset();
+}
+
+Udp_client_transport::Udp_client_transport(
+  const std::string& host,
+  uint16_t port,
+  const Link_config& link,
+  uint64_t stream,
+  Wire_format format
+)
+  : _socket(0, client_receive_batch, max_datagram_size),
+    _link(link, stream),
+    _format(format)
+{
+    _server_address.sin_family = AF_INET;
+    _server_address.sin_port = htons(port);
+
+    if (::inet_pton(AF_INET, host.c_str(), &_server_address.sin_addr) != 1) {
+        throw std::system_error(
+          std::make_error_code(std::errc::invalid_argument), "inet_pton: " + host
+        );
+    }
+}
+
+void Udp_client_transport::send(const Client_message& msg)
+{
+    _batcher.add(msg);
+}
+
+void Udp_client_transport::send(const Client_ack& ack)
+{
+    append_datagram(
+      _send_buffer,
+      _datagrams,
+      _server_address,
+      Packet_type::ack,
+      _format.max_client_message_size(),
+      [this, &ack](std::span<std::byte> out) { return _format.encode(ack, out); }
+    );
+}
+
+void Udp_client_transport::flush()
+{
+    if (!_connected) {
+        append_datagram(
+          _send_buffer, _datagrams, _server_address, Packet_type::connect
+        );
+    }
+    else if (const auto batch = _batcher.take()) {
+        append_datagram(
+          _send_buffer,
+          _datagrams,
+          _server_address,
+          Packet_type::input,
+          _format.max_client_message_size(),
+          [this, &batch](std::span<std::byte> out) {
+              return _format.encode(*batch, out);
+          }
+        );
+    }
+
+    _socket.send(_send_buffer, _datagrams);
+    _send_buffer.clear();
+    _datagrams.clear();
+}
+
+void Udp_client_transport::poll(Client& client)
+{
+    _socket.receive([this, &client](
+                      const sockaddr_in& /*address*/, std::span<const std::byte> data
+                    ) {
+        if (data.empty()) {
+            return;
+        }
+
+        const auto type = static_cast<Packet_type>(data.front());
+        const auto payload = data.subspan(1);
+
+        if (type == Packet_type::accept) {
+            Client_ack accept{};
+            if (_format.decode(payload, accept)) {
+                client.entity_id(accept.entity_id);
+                _connected = true;
+            }
+            return;
+        }
+
+        if (type != Packet_type::update) {
+            return;
+        }
+
+        const auto delivery =
+          _link.transmit(data.size(), Link_emulator::clock::now());
+        if (delivery.copies == 0) {
+            return;
+        }
+
+        // The update sits in the client's delay queue, so it needs storage of
+        // its own
+        auto storage = _storage_pool.acquire();
+        Server_update update;
+        if (_format.decode(payload, update, *storage)) {
+            update.storage = std::move(storage);
+            for (std::size_t i = 0; i < delivery.copies; ++i) {
+                client.send(update, delivery.delays[i]);
+            }
+        }
+    });
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "common.hpp"
+#include "Input_batcher.hpp"
+#include "Link_emulator.hpp"
+#include "Metrics.hpp"
+#include "Snapshot.hpp"
+#include "Transport.hpp"
+#include "Wire_format.hpp"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace detail {
+
+/// @brief Non-blocking UDP socket that moves datagrams in batches
+///
+/// Readiness is tracked with epoll and datagrams are moved with
+/// sendmmsg/recvmmsg so a whole tick's traffic costs a handful of syscalls.
+class Udp_socket {
+public:
+    struct Datagram {
+        sockaddr_in address;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    using Receive_callback =
+      std::function<void(sockaddr_in const&, std::span<std::byte const>)>;
+
+    /// @brief Opens a socket bound to port on all interfaces (0 = ephemeral)
+    /// @param receive_batch datagrams read per recvmmsg call
+    /// @param max_receive_size largest datagram accepted, bigger ones are dropped
+    /// @throws std::system_error on failure
+    Udp_socket(
+      uint16_t port, std::size_t receive_batch, std::size_t max_receive_size
+    );
+
+    ~Udp_socket();
+
+    DISABLE_COPY(Udp_socket);
+    DISABLE_MOVE(Udp_socket);
+
+    [[nodiscard]]
+    uint16_t port() const;
+
+    /// @brief Sends every datagram, each a slice of buffer
+    /// @return the number of datagrams handed to the kernel
+    std::size_t
+    send(std::span<std::byte const> buffer, std::span<Datagram> datagrams);
+
+    /// @brief Reads every datagram that is ready without blocking
+    /// @return the number of datagrams received
+    std::size_t receive(Receive_callback const& callback);
+
+private:
+    int _fd{-1};
+    int _epoll_fd{-1};
+    std::size_t _receive_batch;
+    std::size_t _max_receive_size;
+    std::vector<std::byte> _receive_buffer;
+    std::vector<iovec> _receive_iovecs;
+    std::vector<mmsghdr> _receive_headers;
+    std::vector<sockaddr_in> _receive_addresses;
+    std::vector<iovec> _send_iovecs;
+    std::vector<mmsghdr> _send_headers;
+};
+}  // namespace detail
+
+/// @brief Server_transport over UDP
+///
+/// Clients announce themselves with a connect packet; the server spawns an
+/// entity for each new address and answers with the entity id. Once
+/// max_entities are alive new addresses are ignored, and left to retry.
+///
+/// Each update goes out as a single datagram, so it can't encode to more than
+/// 65506 bytes (an IPv4 UDP payload less the packet type). Larger ones are
+/// dropped and counted in netcode_server_updates_dropped_total. Nothing splits
+/// them, so a client that sees that many entities gets no updates until it
+/// sees fewer; a Budget_config keeps every update small enough.
+class Udp_server_transport final : public Server_transport {
+    detail::Udp_socket _socket;
+
+    // Updates are encoded into each peer's own buffer, so sends for different
+    // peers can run concurrently. flush() gathers them into _send_buffer.
+    struct Peer {
+        // Of the entity the peer was connected for, a later one in the same
+        // slot belongs to someone else
+        std::size_t id{no_entity};
+        sockaddr_in address{};
+        std::vector<std::byte> buffer;
+        std::vector<detail::Udp_socket::Datagram> datagrams;
+
+        // Only set once the peer has connected
+        std::optional<Client_traffic> traffic;
+
+        // Whether an update too large to send was already logged
+        bool dropped_logged{false};
+    };
+
+    // Indexed by entity_index()
+    std::vector<Peer> _peers;
+    std::unordered_map<uint64_t, std::size_t> _entity_ids;
+
+    Wire_format _format;
+    std::vector<std::byte> _send_buffer;
+    std::vector<detail::Udp_socket::Datagram> _datagrams;
+
+    metrics::Counter* _updates_dropped;
+
+    std::function<double(std::size_t)> _spawn_position;
+    std::size_t _connected{0};
+
+    // Since the last connect was refused for lack of room, so that's logged
+    // once until a client gets in again
+    bool _refusing{false};
+
+public:
+    /// @throws std::system_error if the socket cannot be opened
+    explicit Udp_server_transport(uint16_t port, Wire_format format = Wire_format{});
+
+    [[nodiscard]]
+    uint16_t port() const
+    {
+        return _socket.port();
+    }
+
+    /// @brief Where the entity of each new peer spawns, given how many peers
+    /// connected before it. At 0 unless set.
+    void spawn_position(std::function<double(std::size_t)> position)
+    {
+        _spawn_position = std::move(position);
+    }
+
+    void send(std::size_t entity_id, Server_update const& update) override;
+    void flush() override;
+    void poll(Server& server) override;
+
+    /// @brief Stops sending to the peer of entity_id, and forgets its address so
+    /// a connect request from it spawns a new entity
+    void detach(std::size_t entity_id) override;
+};
+
+/// @brief Client_transport over UDP, see Udp_server_transport
+class Udp_client_transport final : public Client_transport {
+    detail::Udp_socket _socket;
+    sockaddr_in _server_address{};
+    bool _connected{false};
+    Link_emulator _link;
+    Input_batcher _batcher;
+
+    Wire_format _format;
+    std::vector<std::byte> _send_buffer;
+    std::vector<detail::Udp_socket::Datagram> _datagrams;
+
+    // Decoded updates, recycled once the client has processed them
+    Update_storage_pool _storage_pool;
+
+public:
+    /// @param link conditions emulated for updates on arrival, on top of
+    ///   whatever the real link adds
+    /// @param stream picks the link's random stream, give each client its own
+    /// @throws std::system_error if the socket cannot be opened or host is not an
+    ///   IPv4 address
+    Udp_client_transport(
+      std::string const& host,
+      uint16_t port,
+      Link_config const& link = {},
+      uint64_t stream = 0,
+      Wire_format format = Wire_format{}
+    );
+
+    /// @brief Whether the server has assigned this client an entity
+    [[nodiscard]]
+    bool connected() const
+    {
+        return _connected;
+    }
+
+    void send(Client_message const& msg) override;
+    void send(Client_ack const& ack) override;
+
+    /// @brief Sends the input batch and acks, or a connect request until one is
+    /// answered
+    void flush() override;
+
+    void poll(Client& client) override;
+};
@@ -0,0 +1,427 @@
+#include "Wire_format.hpp"
+
+#include "Bit_stream.hpp"
+#include "Entity_registry.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// A 64 bit varint is at most 10 groups of 7 bits plus a continuation bit each
+constexpr std::size_t max_varint_bits{80};
+
+uint64_t quantize(double value, double resolution, unsigned bits)
+{
+    const int64_t half = int64_t{1} << (bits - 1);
+    const auto steps = static_cast<int64_t>(std::llround(value / resolution));
+    return static_cast<uint64_t>(std::clamp(steps, -half, half - 1) + half);
+}
+
+double dequantize(uint64_t value, double resolution, unsigned bits)
+{
+    const int64_t half = int64_t{1} << (bits - 1);
+    return static_cast<double>(static_cast<int64_t>(value) - half) * resolution;
+}
+
+std::size_t to_bytes(std::size_t bits)
+{
+    return (bits + 7) / 8;
+}
+
+// Of a varint holding at most value
+std::size_t varint_bits(uint64_t value)
+{
+    const auto groups = std::max<std::size_t>(1, (std::bit_width(value) + 6) / 7);
+    return groups * 8;
+}
+
+// Slots are 32 bits, the last of them never holds an entity
+constexpr std::size_t largest_index{0xFFFF'FFFEU};
+
+// Signed values interleaved into unsigned ones, so small magnitudes either way
+// make small varints
+uint64_t zigzag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1U) ^
+      static_cast<uint64_t>(value >> 63U);
+}
+
+int64_t unzigzag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1U) ^ -static_cast<int64_t>(value & 1U);
+}
+
+// Of the change from one id's generation to the next's. Varints of a + b never
+// take more than ones of a and b together, so skipping ids, which merges their
+// gaps and changes into the next one's, never adds bits.
+std::size_t generation_bits(uint32_t from, uint32_t to)
+{
+    return from == to ? 0 : varint_bits(zigzag(int64_t{to} - int64_t{from}));
+}
+
+// Where the previous id left off
+struct Id_cursor {
+    std::size_t next_index{0};
+    uint32_t generation{0};
+};
+
+// Of the gap to an id's slot, with room for the bit telling whether its
+// generation changed
+std::size_t gap_bits(std::size_t gap)
+{
+    return varint_bits((uint64_t{gap} << 1U) | 1U);
+}
+
+// Of id, following the one cursor was left at, which it moves past id
+std::size_t id_bits(std::size_t id, Id_cursor& cursor)
+{
+    const auto index = entity_index(id);
+    const auto generation = entity_generation(id);
+    const auto bits = gap_bits(index - std::min(index, cursor.next_index)) +
+      generation_bits(cursor.generation, generation);
+
+    cursor = {.next_index = index + 1, .generation = generation};
+    return bits;
+}
+
+// Ids go out in slot order as the gap from the slot after the previous one,
+// with a bit below it telling whether the generation differs from the previous
+// id's, and if it does, by how much. Freed slots are reused oldest first, so
+// neighbouring slots tend to have been reused as often and share a generation.
+// Gaps are small enough that the bit rarely costs a byte. Fails if id's slot
+// isn't past the previous one's.
+bool write_id(Bit_writer& writer, std::size_t id, Id_cursor& cursor)
+{
+    const auto index = entity_index(id);
+    if (index < cursor.next_index) {
+        return false;
+    }
+
+    const auto generation = entity_generation(id);
+    const uint64_t changed = generation == cursor.generation ? 0 : 1;
+    writer.write_varint((uint64_t{index - cursor.next_index} << 1U) | changed);
+    if (changed != 0) {
+        writer.write_varint(
+          zigzag(int64_t{generation} - int64_t{cursor.generation})
+        );
+    }
+
+    cursor = {.next_index = index + 1, .generation = generation};
+    return true;
+}
+
+// Fails rather than let a slot or generation overflow, which would let ids go
+// backwards or collide
+bool read_id(Bit_reader& reader, Id_cursor& cursor, std::size_t& id)
+{
+    const auto gap_and_changed = reader.read_varint();
+    const auto gap = gap_and_changed >> 1U;
+    if (cursor.next_index > largest_index ||
+        gap > largest_index - cursor.next_index) {
+        return false;
+    }
+    const auto index = cursor.next_index + gap;
+
+    int64_t generation{cursor.generation};
+    if ((gap_and_changed & 1U) != 0) {
+        const auto change = reader.read_varint();
+        if (change > zigzag(int64_t{std::numeric_limits<uint32_t>::max()})) {
+            return false;
+        }
+
+        generation += unzigzag(change);
+        if (generation < 0 || generation > std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+    }
+
+    id = make_entity_id(
+      static_cast<uint32_t>(index), static_cast<uint32_t>(generation)
+    );
+    cursor = {
+      .next_index = index + 1, .generation = static_cast<uint32_t>(generation)};
+    return true;
+}
+
+// tick, baseline, last input and the two counts
+constexpr std::size_t header_bits{32 + 32 + 3 * max_varint_bits};
+
+}  // namespace
+
+Wire_format::Wire_format(Quantization quantization)
+  : _quantization(quantization)
+{}
+
+std::size_t Wire_format::max_size(const Server_update& update) const
+{
+    const auto max_id_bits = gap_bits(largest_index) +
+      generation_bits(0, std::numeric_limits<uint32_t>::max());
+    const std::size_t state_bits =
+      max_id_bits + _quantization.position_bits + _quantization.velocity_bits;
+
+    return to_bytes(
+      header_bits + update.states.size() * state_bits +
+      update.removed.size() * max_id_bits
+    );
+}
+
+std::size_t Wire_format::estimated_size(const Server_update& update) const
+{
+    const auto baseline_delta =
+      update.baseline_tick == 0 ? 0 : update.tick - update.baseline_tick;
+    const auto header = 32 + varint_bits(baseline_delta) + 32 +
+      varint_bits(update.states.size()) + varint_bits(update.removed.size());
+    const auto state_bits =
+      8 + _quantization.position_bits + _quantization.velocity_bits;
+
+    return to_bytes(
+      header + update.states.size() * state_bits + update.removed.size() * 8
+    );
+}
+
+std::size_t Wire_format::max_states(
+  std::size_t bytes,
+  std::span<const Entity_state> candidates,
+  std::span<const std::size_t> removed
+) const
+{
+    // Every removal is sent, in full
+    std::size_t removed_bits{0};
+    Id_cursor cursor;
+    for (const auto id : removed) {
+        removed_bits += id_bits(id, cursor);
+    }
+
+    // The states picked take no more id bits than all the candidates do, nor
+    // more each than the largest slot and generation could
+    std::size_t candidate_bits{0};
+    std::size_t largest_index{0};
+    uint32_t largest_generation{0};
+    cursor = {};
+    for (const auto& state : candidates) {
+        candidate_bits += id_bits(state.id, cursor);
+        largest_index = std::max(largest_index, entity_index(state.id));
+        largest_generation =
+          std::max(largest_generation, entity_generation(state.id));
+    }
+
+    const auto value_bits =
+      _quantization.position_bits + _quantization.velocity_bits;
+    const auto fixed_bits = header_bits + removed_bits;
+    const auto budget_bits = bytes * 8;
+
+    if (budget_bits < fixed_bits) {
+        return 0;
+    }
+
+    auto keep = (budget_bits - fixed_bits) /
+      (gap_bits(largest_index) + generation_bits(0, largest_generation) +
+       value_bits);
+    if (budget_bits >= fixed_bits + candidate_bits) {
+        keep =
+          std::max(keep, (budget_bits - fixed_bits - candidate_bits) / value_bits);
+    }
+    return keep;
+}
+
+std::size_t Wire_format::max_client_message_size() const
+{
+    // An input batch's count and durations, or an ack's tick
+    const std::size_t batch_bits =
+      max_varint_bits + max_batched_inputs * _quantization.duration_bits;
+    const std::size_t payload_bits = std::max<std::size_t>(batch_bits, 32);
+    return to_bytes(max_varint_bits + 32 + payload_bits);
+}
+
+std::size_t
+Wire_format::encode(const Server_update& update, std::span<std::byte> out) const
+{
+    Bit_writer writer(out);
+
+    writer.write(update.tick, 32);
+
+    // Sent relative to tick, so recent baselines take a single byte
+    writer.write_varint(
+      update.baseline_tick == 0 ? 0 : update.tick - update.baseline_tick
+    );
+    writer.write(update.last_processed_input, 32);
+    writer.write_varint(update.states.size());
+
+    Id_cursor cursor;
+    for (const auto& state : update.states) {
+        if (!write_id(writer, state.id, cursor)) {
+            return 0;
+        }
+
+        writer.write(
+          quantize(
+            state.position,
+            _quantization.position_resolution,
+            _quantization.position_bits
+          ),
+          _quantization.position_bits
+        );
+        writer.write(
+          quantize(
+            state.velocity,
+            _quantization.velocity_resolution,
+            _quantization.velocity_bits
+          ),
+          _quantization.velocity_bits
+        );
+    }
+
+    writer.write_varint(update.removed.size());
+
+    cursor = {};
+    for (const auto id : update.removed) {
+        if (!write_id(writer, id, cursor)) {
+            return 0;
+        }
+    }
+
+    return writer.overflowed() ? 0 : writer.bytes_written();
+}
+
+std::size_t
+Wire_format::encode(const Input_batch& batch, std::span<std::byte> out) const
+{
+    if (batch.count > max_batched_inputs) {
+        return 0;
+    }
+
+    Bit_writer writer(out);
+
+    writer.write_varint(batch.entity_id);
+    writer.write(batch.last_sequence_number, 32);
+    writer.write_varint(batch.count);
+
+    for (uint32_t i = 0; i < batch.count; ++i) {
+        writer.write(
+          quantize(
+            batch.durations[i].count(),
+            _quantization.duration_resolution,
+            _quantization.duration_bits
+          ),
+          _quantization.duration_bits
+        );
+    }
+
+    return writer.overflowed() ? 0 : writer.bytes_written();
+}
+
+std::size_t
+Wire_format::encode(const Client_ack& ack, std::span<std::byte> out) const
+{
+    Bit_writer writer(out);
+
+    writer.write_varint(ack.entity_id);
+    writer.write(ack.tick, 32);
+
+    return writer.overflowed() ? 0 : writer.bytes_written();
+}
+
+bool Wire_format::decode(
+  std::span<const std::byte> in, Server_update& out, Update_storage& storage
+) const
+{
+    Bit_reader reader(in);
+
+    out.tick = static_cast<uint32_t>(reader.read(32));
+
+    const auto baseline_delta = reader.read_varint();
+    if (baseline_delta > out.tick) {
+        return false;
+    }
+    out.baseline_tick =
+      baseline_delta == 0 ? 0 : out.tick - static_cast<uint32_t>(baseline_delta);
+
+    out.last_processed_input = static_cast<uint32_t>(reader.read(32));
+
+    // Each state takes at least a byte of id plus a position and velocity,
+    // don't trust a count the buffer couldn't hold
+    const auto state_bits =
+      8 + _quantization.position_bits + _quantization.velocity_bits;
+    const auto count = reader.read_varint();
+    if (reader.failed() || count > in.size() * 8 / state_bits) {
+        return false;
+    }
+
+    storage.states.resize(count);
+
+    Id_cursor cursor;
+    for (auto& state : storage.states) {
+        if (!read_id(reader, cursor, state.id)) {
+            return false;
+        }
+
+        state.position = dequantize(
+          reader.read(_quantization.position_bits),
+          _quantization.position_resolution,
+          _quantization.position_bits
+        );
+        state.velocity = dequantize(
+          reader.read(_quantization.velocity_bits),
+          _quantization.velocity_resolution,
+          _quantization.velocity_bits
+        );
+    }
+
+    const auto removed_count = reader.read_varint();
+    if (reader.failed() || removed_count > in.size()) {
+        return false;
+    }
+
+    storage.removed.resize(removed_count);
+
+    cursor = {};
+    for (auto& id : storage.removed) {
+        if (!read_id(reader, cursor, id)) {
+            return false;
+        }
+    }
+
+    out.states = storage.states;
+    out.removed = storage.removed;
+
+    return !reader.failed();
+}
+
+bool Wire_format::decode(std::span<const std::byte> in, Input_batch& out) const
+{
+    Bit_reader reader(in);
+
+    out.entity_id = reader.read_varint();
+    out.last_sequence_number = static_cast<uint32_t>(reader.read(32));
+
+    // More inputs than sequence numbers before the last would wrap the first
+    const auto count = reader.read_varint();
+    if (reader.failed() || count > max_batched_inputs ||
+        count > out.last_sequence_number) {
+        return false;
+    }
+    out.count = static_cast<uint32_t>(count);
+
+    for (uint32_t i = 0; i < out.count; ++i) {
+        out.durations[i] = std::chrono::duration<double>{dequantize(
+          reader.read(_quantization.duration_bits),
+          _quantization.duration_resolution,
+          _quantization.duration_bits
+        )};
+    }
+
+    return !reader.failed();
+}
+
+bool Wire_format::decode(std::span<const std::byte> in, Client_ack& out) const
+{
+    Bit_reader reader(in);
+
+    out.entity_id = reader.read_varint();
+    out.tick = static_cast<uint32_t>(reader.read(32));
+
+    return !reader.failed();
+}
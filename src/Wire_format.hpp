@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Command_message.hpp"
+#include "Server_update.hpp"
+
+#include <cstddef>
+#include <span>
+
+/// @brief Fixed-point precision of the quantized fields
+///
+/// A value is sent as round(value / resolution) in the given number of bits,
+/// so it decodes to within resolution / 2 of the original. Values outside the
+/// representable range are clamped.
+struct Quantization {
+    double position_resolution{1.0 / 32.0};
+    unsigned position_bits{24};
+
+    // Units per second
+    double velocity_resolution{1.0 / 16.0};
+    unsigned velocity_bits{16};
+
+    // Seconds
+    double duration_resolution{1.0 / 10000.0};
+    unsigned duration_bits{16};
+};
+
+/// @brief Bit-packed binary encoding of the messages exchanged with the server
+///
+/// Encoding writes into a caller-provided buffer and decoding into
+/// caller-provided storage, reusing its capacity, so neither allocates once
+/// warmed up. Entity ids are sent as varint gaps from the previous id's slot,
+/// with the change in generation from it only if there is one, ticks as
+/// varint deltas, positions, velocities and durations quantized.
+class Wire_format {
+    Quantization _quantization;
+
+public:
+    explicit Wire_format(Quantization quantization = {});
+
+    [[nodiscard]]
+    Quantization const& quantization() const
+    {
+        return _quantization;
+    }
+
+    /// @brief Largest error a position can pick up in a round trip, if in range
+    [[nodiscard]]
+    double position_error_bound() const
+    {
+        return _quantization.position_resolution / 2;
+    }
+
+    /// @brief Largest error a velocity can pick up in a round trip, if in range
+    [[nodiscard]]
+    double velocity_error_bound() const
+    {
+        return _quantization.velocity_resolution / 2;
+    }
+
+    /// @brief Largest error a duration can pick up in a round trip (seconds), if
+    /// in range
+    [[nodiscard]]
+    double duration_error_bound() const
+    {
+        return _quantization.duration_resolution / 2;
+    }
+
+    /// @brief Upper bound on the encoded size of update, for sizing buffers
+    [[nodiscard]]
+    std::size_t max_size(Server_update const& update) const;
+
+    /// @brief Encoded size of update if each of its ids takes a single byte,
+    /// as they do while they're fewer than 64 slots apart and share a
+    /// generation. O(1), for costing updates that are never encoded.
+    [[nodiscard]]
+    std::size_t estimated_size(Server_update const& update) const;
+
+    /// @brief Most states an update can carry within bytes alongside removed,
+    /// whichever of candidates they are
+    /// @param candidates sorted by id
+    /// @param removed sorted by id
+    [[nodiscard]]
+    std::size_t max_states(
+      std::size_t bytes,
+      std::span<Entity_state const> candidates,
+      std::span<std::size_t const> removed
+    ) const;
+
+    /// @brief Upper bound on the encoded size of an Input_batch or Client_ack
+    [[nodiscard]]
+    std::size_t max_client_message_size() const;
+
+    /// @return the number of bytes written, or 0 if out is too small
+    std::size_t encode(Server_update const& update, std::span<std::byte> out) const;
+    std::size_t encode(Input_batch const& batch, std::span<std::byte> out) const;
+    std::size_t encode(Client_ack const& ack, std::span<std::byte> out) const;
+
+    /// @brief Decodes an update whose states and removals live in storage
+    ///
+    /// storage's contents are replaced; out.storage is left for the caller to
+    /// point at it if it's shared.
+    /// @return false if in is truncated or malformed, out is then unspecified
+    bool decode(
+      std::span<std::byte const> in, Server_update& out, Update_storage& storage
+    ) const;
+
+    /// @return false if in is truncated or malformed, out is then unspecified
+    bool decode(std::span<std::byte const> in, Input_batch& out) const;
+    bool decode(std::span<std::byte const> in, Client_ack& out) const;
+};
@@ -1,7 +1,10 @@
 #include "Client.hpp"
 #include "Config.hpp"
+#include "Local_transport.hpp"
+#include "Metrics.hpp"
 #include "SDL.hpp"
 #include "Server.hpp"
+#include "Tick_scheduler.hpp"
 #include "Utils.hpp"
 
 #include <CLI/CLI.hpp>
@@ -10,10 +13,91 @@
 #include <imgui_impl_sdlrenderer2.h>
 #include <spdlog/spdlog.h>
 
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <variant>
 
 using namespace std::chrono_literals;
 
+namespace {
+
+// Every registered metric, counters with their rate over the last second and
+// histograms summarized by a few quantiles
+void show_metrics_window()
+{
+    struct Rate {
+        uint64_t value{0};
+        double per_second{0.0};
+    };
+
+    static std::unordered_map<const metrics::Counter*, Rate> rates;
+    static auto last_sample = std::chrono::steady_clock::now();
+
+    const auto now = std::chrono::steady_clock::now();
+    const seconds_d elapsed = now - last_sample;
+    const bool resample = elapsed >= 1s;
+    if (resample) {
+        last_sample = now;
+    }
+
+    ImGui::Begin("Metrics");
+
+    if (ImGui::BeginTable("metrics", 3, ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Metric");
+        ImGui::TableSetupColumn("Value");
+        ImGui::TableSetupColumn("Rate / distribution");
+        ImGui::TableHeadersRow();
+
+        metrics::registry().visit([&](const metrics::Metric& metric) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (metric.labels.empty()) {
+                ImGui::TextUnformatted(metric.name.c_str());
+            }
+            else {
+                ImGui::Text("%s{%s}", metric.name.c_str(), metric.labels.c_str());
+            }
+
+            ImGui::TableNextColumn();
+            if (const auto* counter = std::get_if<metrics::Counter>(&metric.value)) {
+                const auto value = counter->value();
+                auto& rate = rates[counter];
+                if (resample) {
+                    rate.per_second =
+                      static_cast<double>(value - rate.value) / elapsed.count();
+                    rate.value = value;
+                }
+
+                ImGui::TextUnformatted(std::to_string(value).c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f/s", rate.per_second);
+            }
+            else if (const auto* gauge =
+                       std::get_if<metrics::Gauge>(&metric.value)) {
+                ImGui::Text("%.1f", gauge->value());
+            }
+            else if (const auto* histogram =
+                       std::get_if<metrics::Histogram>(&metric.value)) {
+                ImGui::TextUnformatted(std::to_string(histogram->count()).c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text(
+                  "p50 %.3g  p99 %.3g  max %.3g",
+                  histogram->quantile(0.5),
+                  histogram->quantile(0.99),
+                  histogram->max()
+                );
+            }
+        });
+
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+}  // namespace
+
 int main(int argc, char* argv[])
 {
     CLI::App app;
@@ -28,22 +112,71 @@ int main(int argc, char* argv[])
       "Number of ticks to delay entities for interpolation"
     );
 
+    bool adaptive_delay{false};
+
+    app.add_flag(
+      "--adaptive-delay",
+      adaptive_delay,
+      "Tune the interpolation delay to the jitter of updates, starting from "
+      "--interp-delay"
+    );
+
+    double extrapolation_ms{0.0};
+
+    app.add_option(
+      "--extrapolate",
+      extrapolation_ms,
+      "Milliseconds to keep entities moving along their velocity when snapshots "
+      "run late, instead of freezing them"
+    );
+
+    std::size_t server_threads{1};
+
+    app.add_option(
+      "--server-threads",
+      server_threads,
+      "Threads the server spreads each tick across, including its own"
+    );
+
     CLI11_PARSE(app, argc, argv);
 
     spdlog::set_level(spdlog::level::debug);
 
     Client client;
     Client spectator;
+    spectator.adaptive_delay({.enabled = adaptive_delay});
+    spectator.extrapolation({.limit = milliseconds_d{extrapolation_ms}});
+
+    // Both directions of every link share the same conditions
+    Link_config link{.latency = config.latency()};
+
+    Local_server_transport server_transport(link);
+    Server server(server_transport, server_threads);
+    Local_client_transport client_transport(server, link, 0);
+    Local_client_transport spectator_transport(server, link, 1);
 
-    Server server(config.latency());
-    client.entity_id(server.connect(&client));
-    spectator.entity_id(server.connect(&spectator));
+    client.entity_id(server.connect());
+    server_transport.attach(client.entity_id(), &client);
+
+    spectator.entity_id(server.connect());
+    server_transport.attach(spectator.entity_id(), &spectator);
 
     const std::jthread server_thread([&server,
                                       &config](const std::stop_token& stop_token) {
+        const auto interval = [&config] {
+            return std::chrono::duration_cast<Tick_scheduler::clock::duration>(
+              config.server_update_interval()
+            );
+        };
+
+        Tick_scheduler scheduler(interval());
+
         while (!stop_token.stop_requested()) {
+            // Picks up changes to the server rate from the UI
+            scheduler.interval(interval());
+            server.tick_interval(config.server_update_interval());
+            scheduler.wait();
             server.update();
-            std::this_thread::sleep_for(config.server_update_interval());
         }
     });
 
@@ -108,6 +241,15 @@ int main(int argc, char* argv[])
         client.process_server_messages();
         spectator.process_server_messages();
 
+        // Let the server delta-compress against what we've reconstructed
+        if (const auto ack = client.acknowledgement()) {
+            client_transport.send(*ack);
+        }
+        if (const auto ack = spectator.acknowledgement()) {
+            spectator_transport.send(*ack);
+        }
+        spectator_transport.flush();
+
         // Compute the duration of the last frame, so we can determine
         // how far the player should move
         auto now = std::chrono::steady_clock::now();
@@ -138,7 +280,7 @@ int main(int argc, char* argv[])
               .entity_id = client.entity_id(),
               .duration = -frame_duration_s,
               .sequence_number = ++sequence_number};
-            server.send(msg, config.latency());
+            client_transport.send(msg);
 
             // Client prediction
             if (config.prediction()) {
@@ -157,7 +299,7 @@ int main(int argc, char* argv[])
               .entity_id = client.entity_id(),
               .duration = frame_duration_s,
               .sequence_number = ++sequence_number};
-            server.send(msg, config.latency());
+            client_transport.send(msg);
 
             // Client prediction
             if (config.prediction()) {
@@ -174,6 +316,9 @@ int main(int argc, char* argv[])
             }
         }
 
+        // One batch of the frame's and recent inputs, plus the ack from above
+        client_transport.flush();
+
         if (config.interpolation()) {
             // NOTE: Normally all clients would interpolate, but since we only have
             //  one entity in our world, then only the spectator needs to
@@ -192,10 +337,29 @@ int main(int argc, char* argv[])
         ImGui::Checkbox("Reconciliation", &config.reconciliation());
         ImGui::Checkbox("Interpolation", &config.interpolation());
 
+        const auto apply_link = [&] {
+            link.latency = config.latency();
+            server_transport.link(link);
+            client_transport.link(link);
+            spectator_transport.link(link);
+        };
+
         static int latency_ms = static_cast<int>(config.latency().count());
         if (ImGui::SliderInt("Lag (ms)", &latency_ms, 0, 1000)) {
             config.latency(std::chrono::milliseconds{latency_ms});
-            server.set_network_delay(config.latency());
+            apply_link();
+        }
+
+        static int jitter_ms = 0;
+        if (ImGui::SliderInt("Jitter (ms)", &jitter_ms, 0, 250)) {
+            link.jitter = std::chrono::milliseconds{jitter_ms};
+            apply_link();
+        }
+
+        static float loss_percent = 0.0F;
+        if (ImGui::SliderFloat("Loss (%)", &loss_percent, 0.0F, 50.0F)) {
+            link.loss = static_cast<double>(loss_percent) / 100.0;
+            apply_link();
         }
 
         static float server_hz = config.server_update_rate();
@@ -212,7 +376,10 @@ int main(int argc, char* argv[])
             config = Config();
 
             latency_ms = static_cast<int>(config.latency().count());
-            server.set_network_delay(config.latency());
+            jitter_ms = 0;
+            loss_percent = 0.0F;
+            link = Link_config{};
+            apply_link();
 
             client_hz = config.client_update_rate();
             server_hz = config.server_update_rate();
@@ -225,6 +392,9 @@ int main(int argc, char* argv[])
         );
 
         ImGui::End();
+
+        show_metrics_window();
+
         ImGui::Render();
 
         RETURN_IF_SDL_ERROR(
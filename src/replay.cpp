@@ -0,0 +1,401 @@
+#include "Client.hpp"
+#include "Clock.hpp"
+#include "Recorder.hpp"
+#include "Server.hpp"
+#include "Transport.hpp"
+
+#include <CLI/CLI.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Ids carry their generation in the high bits, so the tick can't share a word
+// with them
+using Update_key = std::pair<uint32_t, std::size_t>;
+
+struct Update_key_hash {
+    std::size_t operator()(Update_key const& key) const
+    {
+        const auto id_hash = std::hash<std::size_t>{}(key.second);
+        return id_hash ^
+          (std::hash<uint32_t>{}(key.first) + 0x9e3779b97f4a7c15U +
+           (id_hash << 6U) + (id_hash >> 2U));
+    }
+};
+
+// Moves clock to when record was made. Records from different threads can be
+// slightly out of time order, so it never goes back.
+void catch_up(Virtual_clock& clock, Record const& record)
+{
+    const Clock::time_point time{
+      std::chrono::duration_cast<Clock::duration>(record.time)};
+    if (time > clock.now()) {
+        clock.set(time);
+    }
+}
+
+// Drops the replayed server's updates, or compares them with the ones it sent
+// while recording
+class Replay_transport final : public Server_transport {
+public:
+    explicit Replay_transport(Recording_reader* recorded)
+    {
+        if (recorded == nullptr) {
+            return;
+        }
+
+        while (const auto record = recorded->next()) {
+            if (record->type != Record_type::update_sent ||
+                record->payload.size() < sizeof(recording::Update)) {
+                continue;
+            }
+
+            recording::Update header{};
+            std::memcpy(&header, record->payload.data(), sizeof(header));
+            _recorded.emplace(
+              Update_key{header.tick, header.entity_id}, record->payload
+            );
+        }
+
+        recorded->rewind();
+    }
+
+    void send(std::size_t entity_id, Server_update const& update) override
+    {
+        if (_recorded.empty()) {
+            return;
+        }
+
+        ++_compared;
+
+        const auto recorded = _recorded.find(Update_key{update.tick, entity_id});
+        if (recorded == _recorded.end() || !matches(recorded->second, update)) {
+            _mismatches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void flush() override {}
+    void poll(Server& /*server*/) override {}
+
+    [[nodiscard]]
+    uint64_t mismatches() const
+    {
+        return _mismatches.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    uint64_t compared() const
+    {
+        return _compared.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Payloads of the recorded update_sent records, by tick and entity
+    std::unordered_map<Update_key, std::span<const std::byte>, Update_key_hash>
+      _recorded;
+    std::atomic<uint64_t> _compared{0};
+    std::atomic<uint64_t> _mismatches{0};
+
+    static bool
+    matches(std::span<const std::byte> recorded, Server_update const& update)
+    {
+        recording::Update header{};
+        if (recorded.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, recorded.data(), sizeof(header));
+
+        const auto states = std::as_bytes(update.states);
+        const auto removed = std::as_bytes(update.removed);
+
+        return header.baseline_tick == update.baseline_tick &&
+          header.last_processed_input == update.last_processed_input &&
+          header.states_count == update.states.size() &&
+          header.removed_count == update.removed.size() &&
+          recorded.size() >= sizeof(header) + states.size() + removed.size() &&
+          std::memcmp(
+            recorded.data() + sizeof(header), states.data(), states.size()
+          ) == 0 &&
+          std::memcmp(
+            recorded.data() + sizeof(header) + states.size(),
+            removed.data(),
+            removed.size()
+          ) == 0;
+    }
+};
+
+struct Replay_stats {
+    std::vector<double> costs_ms;
+    std::size_t messages{0};
+
+    void report(const char* what, std::chrono::steady_clock::duration elapsed)
+    {
+        const seconds_d elapsed_s = elapsed;
+        spdlog::info(
+          "[replay] {} {} in {:.3f} s ({:.1f}/s), {} messages",
+          costs_ms.size(),
+          what,
+          elapsed_s.count(),
+          static_cast<double>(costs_ms.size()) / elapsed_s.count(),
+          messages
+        );
+
+        if (costs_ms.empty()) {
+            return;
+        }
+
+        std::sort(costs_ms.begin(), costs_ms.end());
+        const auto percentile = [this](double p) {
+            const auto index = static_cast<std::size_t>(
+              p * static_cast<double>(costs_ms.size() - 1)
+            );
+            return costs_ms[index];
+        };
+
+        spdlog::info(
+          "[replay] cost (ms): mean={:.4f} p50={:.4f} p99={:.4f} max={:.4f}",
+          std::accumulate(costs_ms.begin(), costs_ms.end(), 0.0) /
+            static_cast<double>(costs_ms.size()),
+          percentile(0.5),
+          percentile(0.99),
+          costs_ms.back()
+        );
+    }
+};
+
+// Feeds the recorded connections and applied messages to a fresh server,
+// ticking it wherever the recorded one ticked
+int replay_server(
+  Recording_reader& reader,
+  std::size_t threads,
+  const Interest_config& interest,
+  const Budget_config& budget,
+  bool verify
+)
+{
+    Replay_transport transport(verify ? &reader : nullptr);
+    Virtual_clock clock;
+    Server server(transport, threads, clock);
+    server.interest(interest);
+    server.budget(budget);
+
+    Replay_stats stats;
+    const auto start = std::chrono::steady_clock::now();
+
+    while (const auto record = reader.next()) {
+        catch_up(clock, *record);
+
+        switch (record->type) {
+        case Record_type::connect: {
+            recording::Connect connect{};
+            if (Recording_reader::read(*record, connect) &&
+                server.connect(connect.spawn_position) != connect.entity_id) {
+                spdlog::error(
+                  "[replay] entity {} spawned out of order", connect.entity_id
+                );
+                return 1;
+            }
+            break;
+        }
+        case Record_type::spawn: {
+            recording::Connect spawn{};
+            if (Recording_reader::read(*record, spawn) &&
+                server.spawn(spawn.spawn_position) != spawn.entity_id) {
+                spdlog::error(
+                  "[replay] entity {} spawned out of order", spawn.entity_id
+                );
+                return 1;
+            }
+            break;
+        }
+        case Record_type::despawn: {
+            recording::Despawn despawn{};
+            if (Recording_reader::read(*record, despawn)) {
+                (void)server.despawn(despawn.entity_id);
+            }
+            break;
+        }
+        case Record_type::input: {
+            Input_batch batch{};
+            if (Recording_reader::read(*record, batch)) {
+                server.send(batch, 0us);
+                ++stats.messages;
+            }
+            break;
+        }
+        case Record_type::ack: {
+            Client_ack ack{};
+            if (Recording_reader::read(*record, ack)) {
+                server.send(ack, 0us);
+                ++stats.messages;
+            }
+            break;
+        }
+        case Record_type::tick: {
+            recording::Tick tick{};
+            if (Recording_reader::read(*record, tick)) {
+                server.tick_interval(milliseconds_d{tick.interval_ms});
+            }
+
+            const auto tick_start = std::chrono::steady_clock::now();
+            server.update();
+            stats.costs_ms.push_back(
+              milliseconds_d{std::chrono::steady_clock::now() - tick_start}.count()
+            );
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    stats.report("ticks", std::chrono::steady_clock::now() - start);
+
+    if (server.stats().inbound_dropped != 0) {
+        spdlog::warn(
+          "[replay] {} messages dropped, more were applied in one tick than the "
+          "inbound queue holds",
+          server.stats().inbound_dropped
+        );
+    }
+
+    if (verify) {
+        spdlog::info(
+          "[replay] {} of {} updates differ from the recording",
+          transport.mismatches(),
+          transport.compared()
+        );
+        return transport.mismatches() == 0 ? 0 : 2;
+    }
+
+    return 0;
+}
+
+// Hands every client the updates it reconstructed while recording, processing
+// them in the same frames
+int replay_clients(Recording_reader& reader)
+{
+    // Clients interpolate against the time the updates were recorded at
+    Virtual_clock clock;
+
+    std::unordered_map<std::size_t, std::unique_ptr<Client>> clients;
+    const auto client = [&clients, &clock](std::size_t entity_id) -> Client& {
+        auto& slot = clients[entity_id];
+        if (!slot) {
+            slot =
+              std::make_unique<Client>(default_interpolation_capacity, clock);
+            slot->entity_id(entity_id);
+        }
+        return *slot;
+    };
+
+    Replay_stats stats;
+    const auto start = std::chrono::steady_clock::now();
+
+    while (const auto record = reader.next()) {
+        catch_up(clock, *record);
+
+        if (record->type == Record_type::update_received) {
+            // Queued updates keep their storage alive until processed
+            auto storage = std::make_shared<Update_storage>();
+            std::size_t entity_id{0};
+            Server_update update;
+            if (Recording_reader::read(*record, entity_id, update, *storage)) {
+                update.storage = std::move(storage);
+                client(entity_id).send(update, 0us);
+                ++stats.messages;
+            }
+        }
+        else if (record->type == Record_type::client_frame) {
+            recording::Client_frame frame{};
+            if (!Recording_reader::read(*record, frame)) {
+                continue;
+            }
+
+            auto& target = client(frame.entity_id);
+            const auto frame_start = std::chrono::steady_clock::now();
+            target.process_server_messages();
+            (void)target.acknowledgement();
+            stats.costs_ms.push_back(
+              milliseconds_d{std::chrono::steady_clock::now() - frame_start}
+                .count()
+            );
+        }
+    }
+
+    stats.report("client frames", std::chrono::steady_clock::now() - start);
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App app{"Plays a recording made with netcode_server --record back"};
+
+    std::string path;
+    app.add_option("recording", path, "File written by --record")->required();
+
+    std::string mode{"server"};
+    app.add_option(
+      "--mode",
+      mode,
+      "server: replay the applied messages into a server, client: replay the "
+      "received updates into clients"
+    );
+
+    std::size_t server_threads{1};
+    app.add_option(
+      "--server-threads",
+      server_threads,
+      "Threads the server spreads each tick across, including its own"
+    );
+
+    // Not part of the recording, so must match the recorded session
+    Interest_config interest{};
+    app.add_option(
+      "--interest-radius", interest.radius, "As given to netcode_server"
+    );
+    app.add_option(
+      "--interest-hysteresis", interest.hysteresis, "As given to netcode_server"
+    );
+
+    Budget_config budget{};
+    app.add_option("--budget", budget.bytes, "As given to netcode_server");
+
+    bool verify{false};
+    app.add_flag(
+      "--verify",
+      verify,
+      "Check the replayed server sends exactly the updates that were recorded"
+    );
+
+    CLI11_PARSE(app, argc, argv);
+
+    Recording_reader reader(path);
+
+    if (mode == "server") {
+        return replay_server(reader, server_threads, interest, budget, verify);
+    }
+
+    if (mode == "client") {
+        return replay_clients(reader);
+    }
+
+    spdlog::error("[replay] unknown mode '{}'", mode);
+    return 1;
+}
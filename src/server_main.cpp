@@ -0,0 +1,658 @@
+#include "Client.hpp"
+#include "Clock.hpp"
+#include "Config.hpp"
+#include "Local_transport.hpp"
+#include "Metrics.hpp"
+#include "Recorder.hpp"
+#include "Server.hpp"
+#include "Tick_scheduler.hpp"
+#include "Trace.hpp"
+
+#ifdef NETCODE_HAS_UDP
+#include "Udp_transport.hpp"
+#endif
+
+#include <CLI/CLI.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested{0};
+
+void on_signal(int /*signal*/)
+{
+    stop_requested = 1;
+}
+
+struct Simulated_client {
+    explicit Simulated_client(Clock const& clock)
+      : client(default_interpolation_capacity, clock)
+    {}
+
+    Client client;
+    std::unique_ptr<Client_transport> transport;
+};
+
+struct Tick_stats {
+    std::vector<double> costs_ms;
+    std::size_t inputs_sent{0};
+    std::size_t updates_sent{0};
+
+    void report(
+      seconds_d elapsed,
+      const Server_stats& server_stats,
+      const Tick_scheduler_stats& scheduler_stats
+    ) const
+    {
+        if (costs_ms.empty()) {
+            spdlog::warn("[server] no ticks were run");
+            return;
+        }
+
+        std::vector<double> sorted = costs_ms;
+        std::sort(sorted.begin(), sorted.end());
+
+        const auto percentile = [&sorted](double p) {
+            const auto index =
+              static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1));
+            return sorted[index];
+        };
+
+        const double total_ms = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+        const auto ticks = static_cast<double>(sorted.size());
+
+        spdlog::info(
+          "[server] {} ticks in {:.3f} s ({:.1f} ticks/s)",
+          sorted.size(),
+          elapsed.count(),
+          ticks / elapsed.count()
+        );
+        spdlog::info(
+          "[server] tick cost (ms): mean={:.4f} min={:.4f} p50={:.4f} p99={:.4f} "
+          "max={:.4f}",
+          total_ms / ticks,
+          sorted.front(),
+          percentile(0.50),
+          percentile(0.99),
+          sorted.back()
+        );
+        spdlog::info(
+          "[server] throughput: {} inputs ({:.1f}/s), {} updates ({:.1f}/s), "
+          "busy {:.2f}%",
+          inputs_sent,
+          static_cast<double>(inputs_sent) / elapsed.count(),
+          updates_sent,
+          static_cast<double>(updates_sent) / elapsed.count(),
+          100.0 * total_ms / milliseconds_d{elapsed}.count()
+        );
+
+        const auto snapshots =
+          server_stats.full_snapshots + server_stats.delta_snapshots;
+        spdlog::info(
+          "[server] snapshots: {} full, {} delta, {:.1f} entity states, {:.1f} "
+          "removals and {:.1f} deferred states per update",
+          server_stats.full_snapshots,
+          server_stats.delta_snapshots,
+          snapshots == 0 ? 0.0
+                         : static_cast<double>(server_stats.states_sent) /
+              static_cast<double>(snapshots),
+          snapshots == 0 ? 0.0
+                         : static_cast<double>(server_stats.states_removed) /
+              static_cast<double>(snapshots),
+          snapshots == 0 ? 0.0
+                         : static_cast<double>(server_stats.states_deferred) /
+              static_cast<double>(snapshots)
+        );
+
+        const auto lateness_us = [](std::chrono::nanoseconds lateness) {
+            return std::chrono::duration<double, std::micro>{lateness}.count();
+        };
+        spdlog::info(
+          "[server] schedule: {} overruns, {} ticks skipped, start lateness "
+          "(us): mean={:.1f} max={:.1f}",
+          scheduler_stats.overruns,
+          scheduler_stats.skipped,
+          scheduler_stats.ticks == 0
+            ? 0.0
+            : lateness_us(scheduler_stats.total_lateness) /
+              static_cast<double>(scheduler_stats.ticks),
+          lateness_us(scheduler_stats.max_lateness)
+        );
+
+        if (server_stats.inbound_dropped != 0) {
+            spdlog::warn(
+              "[server] {} client messages dropped, inbound queue full",
+              server_stats.inbound_dropped
+            );
+        }
+    }
+};
+
+void report_link(const char* direction, const Link_stats& stats)
+{
+    spdlog::info(
+      "[server] {}: {} packets, {} lost, {} lost in bursts, {} duplicated, {} "
+      "reordered, {} throttled, {} dropped by the bandwidth cap",
+      direction,
+      stats.packets,
+      stats.lost,
+      stats.burst_lost,
+      stats.duplicated,
+      stats.reordered,
+      stats.throttled,
+      stats.queue_dropped
+    );
+}
+
+// Written beside path and renamed over it, so a scraper never reads half a file
+bool write_metrics(const std::string& path)
+{
+    const auto temporary = path + ".tmp";
+
+    {
+        std::ofstream file(temporary);
+        metrics::registry().write_prometheus(file);
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App app{"Headless netcode server"};
+
+    Config config{};
+
+    float server_hz{60.0F};
+    std::size_t client_count{2};
+    double duration_s{0.0};
+    int latency_ms{static_cast<int>(config.latency().count())};
+
+    app.add_option("--server-hz", server_hz, "Server tick rate");
+    app.add_option(
+      "--clients", client_count, "Number of simulated clients to connect"
+    );
+    app.add_option(
+      "--duration", duration_s, "Seconds to run for, or 0 to run until SIGINT"
+    );
+    app.add_option("--latency", latency_ms, "Simulated one-way latency (ms)");
+
+    Link_config link{};
+    double jitter_ms{0.0};
+    std::string distribution_name{"uniform"};
+
+    app.add_option("--jitter", jitter_ms, "Spread of the simulated latency (ms)");
+    app.add_option(
+      "--jitter-distribution",
+      distribution_name,
+      "uniform: latency +- jitter, normal: jitter is the standard deviation, "
+      "exponential: jitter is the mean of a tail added to latency"
+    );
+    app.add_option("--loss", link.loss, "Chance of losing each packet [0, 1]");
+    app.add_option(
+      "--burst-start",
+      link.burst_start,
+      "Chance of each packet starting a burst of loss [0, 1]"
+    );
+    app.add_option(
+      "--burst-end", link.burst_end, "Chance of each packet ending a burst [0, 1]"
+    );
+    app.add_option(
+      "--burst-loss",
+      link.burst_loss,
+      "Chance of losing each packet during a burst [0, 1]"
+    );
+    app.add_option(
+      "--duplicate", link.duplicate, "Chance of delivering a packet twice [0, 1]"
+    );
+    app.add_option(
+      "--reorder",
+      link.reorder,
+      "Chance of holding a packet back so later ones overtake it [0, 1]"
+    );
+    app.add_option(
+      "--bandwidth",
+      link.bandwidth,
+      "Bytes per second each link carries, excess queues or is dropped "
+      "(0 = unlimited)"
+    );
+    app.add_flag(
+      "--encode-updates",
+      link.encode_updates,
+      "Cost updates over the local transport by encoding them, rather than "
+      "estimating their size"
+    );
+    app.add_option("--seed", link.seed, "Seed of the simulated link conditions");
+
+    std::size_t server_threads{1};
+    app.add_option(
+      "--server-threads",
+      server_threads,
+      "Threads the server spreads each tick across, including its own"
+    );
+
+    std::size_t active_count{std::numeric_limits<std::size_t>::max()};
+    app.add_option(
+      "--active-clients",
+      active_count,
+      "Number of simulated clients sending input, the rest stay idle"
+    );
+
+    Interest_config interest{};
+    double spawn_spread{0.0};
+
+    app.add_option(
+      "--interest-radius",
+      interest.radius,
+      "Only send entities within this distance of a client's own (default: all)"
+    );
+    app.add_option(
+      "--interest-hysteresis",
+      interest.hysteresis,
+      "Extra distance an entity may move away before it stops being sent"
+    );
+    Budget_config budget{};
+    app.add_option(
+      "--budget",
+      budget.bytes,
+      "Bytes each update to a client may take, deferring the entity states that "
+      "matter least to it (default: no limit)"
+    );
+    app.add_option(
+      "--spawn-spread",
+      spawn_spread,
+      "Spawn simulated clients evenly across [0, spread) instead of at 0"
+    );
+
+    bool adaptive_delay{false};
+    app.add_flag(
+      "--adaptive-delay",
+      adaptive_delay,
+      "Simulated clients tune their interpolation delay to the jitter of updates"
+    );
+
+    double extrapolation_ms{0.0};
+    app.add_option(
+      "--extrapolate",
+      extrapolation_ms,
+      "Milliseconds simulated clients keep entities moving along their velocity "
+      "when snapshots run late"
+    );
+
+    std::size_t churn{0};
+    app.add_option(
+      "--churn",
+      churn,
+      "Entities without a client, like projectiles, spawned across the spawn "
+      "spread each tick and despawned a second later"
+    );
+
+    std::string transport_name{"local"};
+    uint16_t udp_port{0};
+
+    app.add_option(
+      "--transport",
+      transport_name,
+      "local: in-process queues, udp: sockets over loopback"
+    );
+    app.add_option("--udp-port", udp_port, "Server UDP port (0 = any free port)");
+
+    std::string trace_path;
+    app.add_option(
+      "--trace",
+      trace_path,
+      "Write the trace events recorded while running to this file, as Chrome "
+      "trace JSON"
+    );
+
+    std::string metrics_path;
+    double metrics_interval_s{5.0};
+
+    app.add_option(
+      "--metrics",
+      metrics_path,
+      "Periodically write the live metrics to this file, in Prometheus text "
+      "format"
+    );
+    app.add_option(
+      "--metrics-interval", metrics_interval_s, "Seconds between metrics writes"
+    );
+
+    std::string record_path;
+    std::size_t record_mib{1024};
+
+    app.add_option(
+      "--record",
+      record_path,
+      "Record the session to this file, for netcode_replay to play back"
+    );
+    app.add_option(
+      "--record-size",
+      record_mib,
+      "Most MiB to record, later messages are dropped (the file is sparse)"
+    );
+
+    bool virtual_time{false};
+    app.add_flag(
+      "--virtual-time",
+      virtual_time,
+      "Advance a simulated clock by one tick interval per tick instead of "
+      "waiting for real time, running as fast as possible (local transport "
+      "only); --duration is then simulated seconds"
+    );
+
+    CLI11_PARSE(app, argc, argv);
+
+    // Per-message events go to the trace instead, see --trace
+    spdlog::set_level(spdlog::level::warn);
+
+    config.server_update_rate(server_hz);
+    config.latency(std::chrono::milliseconds{latency_ms});
+
+    link.latency = config.latency();
+    link.jitter = std::chrono::duration_cast<std::chrono::microseconds>(
+      milliseconds_d{jitter_ms}
+    );
+
+    if (distribution_name == "uniform") {
+        link.distribution = Jitter_distribution::uniform;
+    }
+    else if (distribution_name == "normal") {
+        link.distribution = Jitter_distribution::normal;
+    }
+    else if (distribution_name == "exponential") {
+        link.distribution = Jitter_distribution::exponential;
+    }
+    else {
+        spdlog::error(
+          "[server] unknown jitter distribution '{}'", distribution_name
+        );
+        return 1;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    const bool use_udp = transport_name == "udp";
+    if (!use_udp && transport_name != "local") {
+        spdlog::error("[server] unknown transport '{}'", transport_name);
+        return 1;
+    }
+
+#ifndef NETCODE_HAS_UDP
+    if (use_udp) {
+        spdlog::error("[server] the udp transport is only built on Linux");
+        return 1;
+    }
+#endif
+
+    // Sockets deliver in real time whatever the clock says
+    if (use_udp && virtual_time) {
+        spdlog::error("[server] --virtual-time needs the local transport");
+        return 1;
+    }
+
+    Virtual_clock virtual_clock;
+    const Clock* clock = virtual_time ? &virtual_clock : &real_clock();
+
+    std::unique_ptr<Server_transport> server_transport;
+    Local_server_transport* local_transport{nullptr};
+#ifdef NETCODE_HAS_UDP
+    Udp_server_transport* udp_transport{nullptr};
+
+    if (use_udp) {
+        auto transport = std::make_unique<Udp_server_transport>(udp_port);
+        // Spread like the local clients, in the order they connect
+        transport->spawn_position([&](std::size_t connected) {
+            return spawn_spread * static_cast<double>(connected) /
+              static_cast<double>(std::max<std::size_t>(client_count, 1));
+        });
+        udp_transport = transport.get();
+        server_transport = std::move(transport);
+    }
+    else
+#endif
+    {
+        auto transport = std::make_unique<Local_server_transport>(link);
+        local_transport = transport.get();
+        server_transport = std::move(transport);
+    }
+
+    std::unique_ptr<Recorder> recorder;
+    if (!record_path.empty()) {
+        recorder =
+          std::make_unique<Recorder>(record_path, record_mib << 20U, *clock);
+    }
+
+    Server server(*server_transport, server_threads, *clock);
+    server.tick_interval(config.server_update_interval());
+    server.interest(interest);
+    server.budget(budget);
+    server.recorder(recorder.get());
+
+    // Headless clients only drain their queues; nothing is rendered.
+    std::vector<std::unique_ptr<Simulated_client>> clients;
+    for (std::size_t i = 0; i < client_count; ++i) {
+        auto& sim =
+          clients.emplace_back(std::make_unique<Simulated_client>(*clock));
+        sim->client.recorder(recorder.get());
+        sim->client.adaptive_delay({.enabled = adaptive_delay});
+        sim->client.extrapolation({.limit = milliseconds_d{extrapolation_ms}});
+
+#ifdef NETCODE_HAS_UDP
+        if (use_udp) {
+            sim->transport = std::make_unique<Udp_client_transport>(
+              "127.0.0.1", udp_transport->port(), link, i
+            );
+        }
+        else
+#endif
+        {
+            sim->transport =
+              std::make_unique<Local_client_transport>(server, link, i);
+            const auto spawn_position = spawn_spread *
+              static_cast<double>(i) / static_cast<double>(client_count);
+            sim->client.entity_id(server.connect(spawn_position));
+            local_transport->attach(sim->client.entity_id(), &sim->client);
+        }
+    }
+
+#ifdef NETCODE_HAS_UDP
+    if (use_udp) {
+        spdlog::warn("[server] listening on udp port {}", udp_transport->port());
+
+        // Connect requests are retried on every flush until accepted
+        const auto connect_deadline = std::chrono::steady_clock::now() + 5s;
+        while (!std::all_of(clients.begin(), clients.end(), [](const auto& sim) {
+            return dynamic_cast<Udp_client_transport&>(*sim->transport).connected();
+        })) {
+            if (std::chrono::steady_clock::now() >= connect_deadline) {
+                spdlog::error("[server] timed out connecting simulated clients");
+                return 1;
+            }
+
+            for (auto& sim : clients) {
+                sim->transport->flush();
+            }
+            std::this_thread::sleep_for(1ms);
+            server.update();
+            std::this_thread::sleep_for(1ms);
+            for (auto& sim : clients) {
+                sim->transport->poll(sim->client);
+            }
+        }
+    }
+#endif
+
+    Tick_stats stats;
+    uint32_t sequence_number{0};
+
+    // Churned entities oldest first, with the tick they were spawned in
+    std::deque<std::pair<std::size_t, uint32_t>> projectiles;
+    const auto projectile_lifetime =
+      static_cast<uint32_t>(std::max(1.0F, std::round(server_hz)));
+
+    Tick_scheduler scheduler(
+      std::chrono::duration_cast<Tick_scheduler::clock::duration>(
+        config.server_update_interval()
+      )
+    );
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto simulated_start = clock->now();
+    const auto deadline = simulated_start +
+      std::chrono::duration_cast<Clock::duration>(seconds_d{duration_s});
+
+    const auto metrics_interval =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        seconds_d{metrics_interval_s}
+      );
+    auto next_metrics = start + metrics_interval;
+
+    while (stop_requested == 0) {
+        if (virtual_time) {
+            virtual_clock.advance(scheduler.interval());
+        }
+        else {
+            scheduler.wait();
+        }
+
+        if (duration_s > 0.0 && clock->now() >= deadline) {
+            break;
+        }
+
+        // Every simulated client holds a key down for the whole tick, switching
+        // direction each tick so entities stay near the origin.
+        ++sequence_number;
+        const auto direction = (sequence_number % 2 == 0) ? 1.0 : -1.0;
+        for (std::size_t i = 0; i < std::min(active_count, clients.size()); ++i) {
+            auto& sim = clients[i];
+            const Client_message msg{
+              .entity_id = sim->client.entity_id(),
+              .duration = direction * seconds_d{config.server_update_interval()},
+              .sequence_number = sequence_number};
+            sim->transport->send(msg);
+            stats.inputs_sent += 1;
+        }
+
+        while (!projectiles.empty() &&
+               sequence_number - projectiles.front().second >= projectile_lifetime) {
+            server.despawn(projectiles.front().first);
+            projectiles.pop_front();
+        }
+        for (std::size_t i = 0; i < churn; ++i) {
+            const auto position =
+              spawn_spread * static_cast<double>(i) / static_cast<double>(churn);
+            projectiles.emplace_back(server.spawn(position), sequence_number);
+        }
+
+        const auto tick_start = std::chrono::steady_clock::now();
+        server.update();
+        const auto tick_end = std::chrono::steady_clock::now();
+
+        stats.costs_ms.push_back(milliseconds_d{tick_end - tick_start}.count());
+        stats.updates_sent += clients.size();
+
+        // Clients go through their whole frame, rendering aside
+        for (auto& sim : clients) {
+            sim->transport->poll(sim->client);
+            sim->client.process_server_messages();
+            sim->client.interpolate_entities(config.server_update_interval(), 1);
+
+            if (const auto ack = sim->client.acknowledgement()) {
+                sim->transport->send(*ack);
+            }
+            sim->transport->flush();
+        }
+
+        if (!metrics_path.empty() &&
+            std::chrono::steady_clock::now() >= next_metrics) {
+            next_metrics += metrics_interval;
+            if (!write_metrics(metrics_path)) {
+                spdlog::error(
+                  "[server] failed to write metrics to {}", metrics_path
+                );
+            }
+        }
+    }
+
+    if (!metrics_path.empty() && !write_metrics(metrics_path)) {
+        spdlog::error("[server] failed to write metrics to {}", metrics_path);
+    }
+
+    if (!trace_path.empty()) {
+        std::ofstream trace_file(trace_path);
+        trace::write_chrome_json(trace_file);
+        if (!trace_file) {
+            spdlog::error("[server] failed to write trace to {}", trace_path);
+        }
+    }
+
+    spdlog::set_level(spdlog::level::info);
+    stats.report(
+      std::chrono::steady_clock::now() - start, server.stats(), scheduler.stats()
+    );
+
+    if (churn != 0) {
+        spdlog::info(
+          "[server] {} entities alive after churning {} per tick",
+          server.entity_count(),
+          churn
+        );
+    }
+
+    if (virtual_time) {
+        spdlog::info(
+          "[server] simulated {:.3f} s",
+          seconds_d{clock->now() - simulated_start}.count()
+        );
+    }
+
+    if (recorder) {
+        spdlog::info(
+          "[server] recorded {:.1f} MiB to {}",
+          static_cast<double>(recorder->size()) / (1024.0 * 1024.0),
+          record_path
+        );
+        if (recorder->dropped() != 0) {
+            spdlog::warn(
+              "[server] {} messages not recorded, --record-size is too small",
+              recorder->dropped()
+            );
+        }
+    }
+
+    if (local_transport != nullptr) {
+        Link_stats uplinks;
+        for (const auto& sim : clients) {
+            uplinks +=
+              dynamic_cast<Local_client_transport&>(*sim->transport).link_stats();
+        }
+
+        report_link("uplinks", uplinks);
+        report_link("downlinks", local_transport->link_stats());
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "Client.hpp"
+#include "Clock.hpp"
+#include "Link_emulator.hpp"
+#include "Metrics.hpp"
+#include "Server_update.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+// A client with an adaptive delay, fed updates over a jittery emulated link on
+// a virtual clock, checking that the delay settles, never moves faster than
+// its slew limit and leaves underruns near the rate it aims for.
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr std::chrono::nanoseconds tick_interval{16'666'667};
+constexpr std::chrono::nanoseconds frame_interval{6'944'444};
+
+// Long enough for the margin to settle from where it starts
+constexpr std::chrono::seconds warm_up{60};
+constexpr std::chrono::seconds measured{120};
+
+struct Outcome {
+    uint64_t frames{0};
+    uint64_t underruns{0};
+    milliseconds_d min_delay{milliseconds_d::max()};
+    milliseconds_d max_delay{0.0};
+    milliseconds_d largest_step{0.0};
+
+    // Of the first and second half of the frames measured
+    milliseconds_d mean_delay[2]{};
+};
+
+Outcome run(const Adaptive_delay_config& config, const Link_config& link_config)
+{
+    Virtual_clock clock;
+    Link_emulator link(link_config);
+
+    Client client(default_interpolation_capacity, clock);
+    client.entity_id(0);
+    client.adaptive_delay(config);
+
+    const std::string labels = metrics::label("client", 0);
+    const auto& underruns = metrics::registry().counter(
+      "netcode_client_interpolation_underruns_total", "", labels
+    );
+    const auto& delay = metrics::registry().gauge(
+      "netcode_client_interpolation_delay_seconds", "", labels
+    );
+
+    Server_update update;
+
+    const auto start = clock.now();
+    auto next_tick = start;
+    auto next_frame = start;
+
+    Outcome outcome;
+    milliseconds_d previous_delay{-1.0};
+    uint64_t underruns_before{0};
+
+    while (next_frame - start < warm_up + measured) {
+        if (next_tick <= next_frame) {
+            clock.set(next_tick);
+            next_tick += tick_interval;
+
+            // Updates in flight keep their own storage
+            ++update.tick;
+            auto storage = std::make_shared<Update_storage>();
+            storage->states.push_back(
+              {.position = static_cast<double>(update.tick),
+               .id = 1,
+               .velocity = 60.0}
+            );
+            update.storage = storage;
+            update.states = storage->states;
+
+            const auto delivery = link.transmit(64, clock.now());
+            for (std::size_t i = 0; i < delivery.copies; ++i) {
+                client.send(update, delivery.delays[i]);
+            }
+            continue;
+        }
+
+        clock.set(next_frame);
+        next_frame += frame_interval;
+
+        client.process_server_messages();
+        client.interpolate_entities(tick_interval, 2);
+
+        const milliseconds_d current{seconds_d{delay.value()}};
+        if (previous_delay.count() >= 0.0) {
+            outcome.largest_step = std::max(
+              outcome.largest_step,
+              milliseconds_d{std::abs((current - previous_delay).count())}
+            );
+        }
+        previous_delay = current;
+
+        if (clock.now() - start < warm_up) {
+            underruns_before = underruns.value();
+            continue;
+        }
+
+        ++outcome.frames;
+        outcome.min_delay = std::min(outcome.min_delay, current);
+        outcome.max_delay = std::max(outcome.max_delay, current);
+
+        const bool second_half = clock.now() - start >= warm_up + measured / 2;
+        outcome.mean_delay[second_half ? 1 : 0] += current;
+    }
+
+    outcome.underruns = underruns.value() - underruns_before;
+    for (auto& mean : outcome.mean_delay) {
+        mean /= static_cast<double>(outcome.frames) / 2;
+    }
+    return outcome;
+}
+
+}  // namespace
+
+int main()
+{
+    const Adaptive_delay_config config{.enabled = true};
+
+    // Fixed, so a failure reproduces
+    const Link_config link{
+      .latency = 50ms,
+      .jitter = 10ms,
+      .distribution = Jitter_distribution::normal,
+      .seed = 0x6e6574636f6465};
+
+    const auto outcome = run(config, link);
+
+    const auto rate = static_cast<double>(outcome.underruns) /
+      static_cast<double>(outcome.frames);
+    spdlog::info(
+      "[test] delay {:.1f}-{:.1f} ms, {:.1f} then {:.1f} ms on average, largest "
+      "step {:.3f} ms, {} underruns in {} frames ({:.4f})",
+      outcome.min_delay.count(),
+      outcome.max_delay.count(),
+      outcome.mean_delay[0].count(),
+      outcome.mean_delay[1].count(),
+      outcome.largest_step.count(),
+      outcome.underruns,
+      outcome.frames,
+      rate
+    );
+
+    // The delay moves by at most max_slew of the time between frames
+    const milliseconds_d max_step{config.max_slew * frame_interval};
+    if (outcome.largest_step > max_step * 1.001) {
+        spdlog::error(
+          "[test] delay moved {:.3f} ms in a frame, more than the slew limit of "
+          "{:.3f} ms",
+          outcome.largest_step.count(),
+          max_step.count()
+        );
+        return EXIT_FAILURE;
+    }
+
+    // Settled: it keeps to a band the jitter accounts for, and doesn't drift
+    // within it
+    const auto drift = outcome.mean_delay[1] - outcome.mean_delay[0];
+    if (outcome.min_delay <= config.min_delay ||
+        outcome.max_delay >= config.max_delay ||
+        outcome.max_delay - outcome.min_delay > 3 * link.jitter ||
+        std::abs(drift.count()) > 2.0) {
+        spdlog::error("[test] delay didn't settle");
+        return EXIT_FAILURE;
+    }
+
+    if (rate < config.target_underrun_rate / 3 ||
+        rate > config.target_underrun_rate * 3) {
+        spdlog::error(
+          "[test] underrun rate {:.4f} is far from the target of {:.4f}",
+          rate,
+          config.target_underrun_rate
+        );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
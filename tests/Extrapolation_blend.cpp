@@ -0,0 +1,209 @@
+#include "Client.hpp"
+#include "Clock.hpp"
+#include "Entity_registry.hpp"
+#include "Server_update.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+// A remote entity moving at a constant velocity, whose updates stop for a
+// while, on a virtual clock. While they are late it has to keep moving along
+// its velocity until the extrapolation limit and then stop; once they resume it
+// has to drift back onto the interpolated path over the blend time rather than
+// jump there.
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// Frames and the latency are whole numbers of frames apart from the ticks, so
+// snapshots are processed exactly when they arrive and the interpolated path
+// is a straight line through them
+constexpr std::chrono::nanoseconds tick_interval{16ms};
+constexpr std::chrono::nanoseconds frame_interval{4ms};
+constexpr std::chrono::microseconds latency{48ms};
+constexpr std::size_t delay_in_ticks{2};
+
+// The entity moves one unit per tick
+constexpr double velocity{1.0 / 0.016};
+
+// Updates sent in between are lost
+constexpr std::chrono::nanoseconds stall_start{2s};
+constexpr std::chrono::nanoseconds stall_end{2400ms};
+constexpr std::chrono::nanoseconds end{3s};
+
+constexpr double tolerance{1e-6};
+
+seconds_d since_start(Clock::time_point time)
+{
+    return time.time_since_epoch();
+}
+
+// Where interpolation renders the entity in the frame at now
+double interpolated(Clock::time_point now)
+{
+    const auto render_time = since_start(now) - delay_in_ticks * tick_interval;
+    return (render_time - latency) / tick_interval;
+}
+
+bool check_position(
+  const char* phase, Clock::time_point now, double position, double expected
+)
+{
+    if (std::abs(position - expected) > tolerance) {
+        spdlog::error(
+          "[test] {} at {:.3f} s: rendered at {}, expected {}",
+          phase,
+          since_start(now).count(),
+          position,
+          expected
+        );
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main()
+{
+    const Extrapolation_config config{.limit = 100ms, .blend = 100ms};
+
+    // Off slot 0, in a reused slot, so it's only found by its id
+    const auto remote = make_entity_id(3, 2);
+
+    Virtual_clock clock;
+    Client client(default_interpolation_capacity, clock);
+    client.entity_id(make_entity_id(1, 0));
+    client.extrapolation(config);
+
+    // The newest update to make it before the stall, and when it was rendered
+    // past
+    const auto last_tick =
+      static_cast<uint32_t>((stall_start - 1ns) / tick_interval);
+    const Clock::time_point last_arrival{last_tick * tick_interval + latency};
+    const auto late_from = last_arrival + delay_in_ticks * tick_interval;
+    const double cap = last_tick + velocity * seconds_d{config.limit}.count();
+
+    // The first update after it, and when it is first rendered
+    const auto resumed_tick =
+      static_cast<uint32_t>((stall_end + tick_interval - 1ns) / tick_interval);
+    const Clock::time_point resumed_from{resumed_tick * tick_interval + latency};
+
+    Server_update update;
+    auto next_tick = Clock::time_point{tick_interval};
+    auto next_frame = Clock::time_point{frame_interval};
+
+    double previous{0.0};
+    double gap{0.0};
+    bool reached_cap{false};
+
+    while (next_frame.time_since_epoch() < end) {
+        // Ticks go first when they land on a frame
+        if (next_tick <= next_frame) {
+            clock.set(next_tick);
+            next_tick += tick_interval;
+
+            ++update.tick;
+            const auto now = clock.now().time_since_epoch();
+            if (now >= stall_start && now < stall_end) {
+                continue;
+            }
+
+            auto storage = std::make_shared<Update_storage>();
+            storage->states.push_back(
+              {.position = static_cast<double>(update.tick),
+               .id = remote,
+               .velocity = velocity}
+            );
+            update.storage = storage;
+            update.states = storage->states;
+            client.send(update, latency);
+            continue;
+        }
+
+        clock.set(next_frame);
+        next_frame += frame_interval;
+
+        client.process_server_messages();
+        client.interpolate_entities(tick_interval, delay_in_ticks);
+
+        const auto now = clock.now();
+        const auto rendered = client.position(remote);
+        const double position = rendered.value_or(0.0);
+        const double step = std::abs(position - previous);
+        previous = position;
+
+        // Let interpolation get going first
+        if (since_start(now) < 200ms) {
+            continue;
+        }
+
+        if (!rendered) {
+            spdlog::error(
+              "[test] entity not rendered at {:.3f} s", since_start(now).count()
+            );
+            return EXIT_FAILURE;
+        }
+
+        if (now <= late_from) {
+            if (!check_position("interpolating", now, position, interpolated(now))) {
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        // Along the velocity until the limit, then still
+        if (now < resumed_from) {
+            const double expected = std::min(
+              cap,
+              last_tick + velocity * seconds_d{now - late_from}.count()
+            );
+            if (!check_position("extrapolating", now, position, expected)) {
+                return EXIT_FAILURE;
+            }
+            reached_cap = reached_cap || std::abs(position - cap) <= tolerance;
+            continue;
+        }
+
+        if (now == resumed_from) {
+            gap = interpolated(now) - cap;
+        }
+
+        // Closing the gap a little each frame on top of the entity's own
+        // motion, never all at once
+        const double closing = std::abs(gap) / seconds_d{config.blend}.count();
+        const double max_step =
+          (velocity + closing) * seconds_d{frame_interval}.count();
+        if (step > max_step + tolerance) {
+            spdlog::error(
+              "[test] blending at {:.3f} s: moved {} in a frame, more than {}",
+              since_start(now).count(),
+              step,
+              max_step
+            );
+            return EXIT_FAILURE;
+        }
+
+        if (now >= resumed_from + config.blend &&
+            !check_position("blended", now, position, interpolated(now))) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!reached_cap || std::abs(gap) <= tolerance) {
+        spdlog::error("[test] entity never reached the extrapolation limit");
+        return EXIT_FAILURE;
+    }
+
+    spdlog::info(
+      "[test] extrapolated to the limit and blended a gap of {} back", gap
+    );
+    return EXIT_SUCCESS;
+}
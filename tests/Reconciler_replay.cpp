@@ -0,0 +1,180 @@
+#include "Reconciler.hpp"
+#include "Utils.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Predictions the server agrees with cost no replay, ones it doesn't are
+// replayed from the input after the last one it processed, and once those
+// inputs are overwritten the entity snaps to the server's position instead.
+
+namespace {
+
+// Each input moves the entity by a different amount, so the position a replay
+// ends at tells which inputs it went through
+std::chrono::duration<double> duration_of(uint32_t sequence_number)
+{
+    return std::chrono::milliseconds{sequence_number};
+}
+
+// Records inputs first to last as the client predicts them, from position
+// @return the position predicted after each, indexed by sequence number
+std::vector<double> predict(
+  Reconciler& reconciler, uint32_t first, uint32_t last, double position
+)
+{
+    std::vector<double> predicted(last + 1, 0.0);
+    for (uint32_t sequence_number = first; sequence_number <= last;
+         ++sequence_number) {
+        position = update_position(position, duration_of(sequence_number).count());
+        predicted[sequence_number] = position;
+        reconciler.record(
+          {.entity_id = 0,
+           .duration = duration_of(sequence_number),
+           .sequence_number = sequence_number},
+          position
+        );
+    }
+    return predicted;
+}
+
+// Where replaying first to last from position ends up
+double replayed(uint32_t first, uint32_t last, double position)
+{
+    for (uint32_t sequence_number = first; sequence_number <= last;
+         ++sequence_number) {
+        position = update_position(position, duration_of(sequence_number).count());
+    }
+    return position;
+}
+
+bool near(double lhs, double rhs)
+{
+    return std::abs(lhs - rhs) < 1e-9;
+}
+
+bool check_match_skips_replay()
+{
+    Reconciler reconciler(16);
+    const auto predicted = predict(reconciler, 1, 10, 0.0);
+
+    // Off by less than the threshold, e.g. from quantization
+    const auto authoritative = predicted[5] + default_reconciliation_threshold / 2;
+    const auto position = reconciler.reconcile(5, authoritative, predicted[10]);
+
+    if (reconciler.replays() != 0 || !near(position, predicted[10])) {
+        spdlog::error(
+          "[test] matching ack replayed {} times, moving {} to {}",
+          reconciler.replays(),
+          predicted[10],
+          position
+        );
+        return false;
+    }
+    return true;
+}
+
+bool check_mismatch_replays_from_next_input()
+{
+    Reconciler reconciler(16);
+    const auto predicted = predict(reconciler, 1, 10, 0.0);
+
+    const auto authoritative = predicted[5] + 1.0;
+    const auto position = reconciler.reconcile(5, authoritative, predicted[10]);
+    const auto expected = replayed(6, 10, authoritative);
+
+    if (reconciler.replays() != 1 || !near(position, expected)) {
+        spdlog::error(
+          "[test] mismatching ack replayed {} times to {}, expected once to {}",
+          reconciler.replays(),
+          position,
+          expected
+        );
+        return false;
+    }
+
+    // The replay corrected the predictions after it, so the server confirming
+    // one of them is a match
+    const auto corrected = replayed(6, 7, authoritative);
+    if (!near(reconciler.reconcile(7, corrected, position), position) ||
+        reconciler.replays() != 1) {
+        spdlog::error("[test] corrected prediction didn't match after a replay");
+        return false;
+    }
+    return true;
+}
+
+bool check_eviction_snaps()
+{
+    constexpr uint32_t capacity{8};
+    constexpr uint32_t newest{20};
+
+    Reconciler reconciler(capacity);
+    const auto predicted = predict(reconciler, 1, newest, 0.0);
+
+    // Inputs 4 to 12 were overwritten, so there's nothing to replay from the
+    // server's position for 3, not even to confirm it
+    const auto authoritative = predicted[3] + 1.0;
+    const auto position =
+      reconciler.reconcile(3, authoritative, predicted[newest]);
+
+    if (reconciler.snaps() != 1 || reconciler.replays() != 0 ||
+        !near(position, authoritative)) {
+        spdlog::error(
+          "[test] ack of an evicted input moved {} to {} after {} snaps and {} "
+          "replays, expected one snap to {}",
+          predicted[newest],
+          position,
+          reconciler.snaps(),
+          reconciler.replays(),
+          authoritative
+        );
+        return false;
+    }
+
+    // The predictions still kept were made from the position the server
+    // corrected, so they're replayed even when the server agrees with one
+    const auto processed = replayed(4, 13, authoritative);
+    const auto expected = replayed(14, newest, processed);
+    const auto corrected = reconciler.reconcile(13, processed, position);
+
+    if (reconciler.replays() != 1 || !near(corrected, expected)) {
+        spdlog::error(
+          "[test] ack after a snap replayed {} times to {}, expected once to {}",
+          reconciler.replays(),
+          corrected,
+          expected
+        );
+        return false;
+    }
+
+    // The ring wraps cleanly: inputs recorded over the old ones match
+    const auto more = predict(reconciler, newest + 1, newest + capacity, corrected);
+    const auto current = more[newest + capacity];
+    const auto confirmed =
+      reconciler.reconcile(newest + 4, more[newest + 4], current);
+    if (!near(confirmed, current) || reconciler.replays() != 1 ||
+        reconciler.snaps() != 1) {
+        spdlog::error("[test] prediction after wrapping the ring didn't match");
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main()
+{
+    if (!check_match_skips_replay() || !check_mismatch_replays_from_next_input() ||
+        !check_eviction_snaps()) {
+        return EXIT_FAILURE;
+    }
+
+    spdlog::info("[test] reconciliation replays only on mismatch");
+    return EXIT_SUCCESS;
+}
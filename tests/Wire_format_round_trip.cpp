@@ -0,0 +1,384 @@
+#include "Wire_format.hpp"
+
+#include "Entity_registry.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <span>
+#include <vector>
+
+// Random messages through encode and decode, checking that every quantized
+// field comes back within the error bound Wire_format advertises for it and
+// everything else comes back exactly.
+
+namespace {
+
+constexpr int rounds{1000};
+
+// Of a field quantized to bits at resolution, with room to spare at the edges
+double in_range(double resolution, unsigned bits)
+{
+    return 0.99 * resolution * static_cast<double>(uint64_t{1} << (bits - 1));
+}
+
+// However many states max_states says fit within a budget, any that many of
+// the candidates do
+bool check_budget(
+  const Wire_format& format,
+  const Server_update& update,
+  std::size_t full_size,
+  std::mt19937_64& random
+)
+{
+    std::uniform_int_distribution<std::size_t> budget(0, full_size);
+    const auto bytes = budget(random);
+    const auto keep = std::min(
+      format.max_states(bytes, update.states, update.removed),
+      update.states.size()
+    );
+
+    std::vector<Entity_state> kept;
+    std::sample(
+      update.states.begin(),
+      update.states.end(),
+      std::back_inserter(kept),
+      keep,
+      random
+    );
+
+    Server_update partial = update;
+    partial.states = kept;
+
+    std::vector<std::byte> buffer(format.max_size(partial));
+    const auto size = format.encode(partial, buffer);
+    if (size == 0 || (keep != 0 && size > bytes)) {
+        spdlog::error(
+          "[test] {} states took {} bytes, over the budget of {} they should "
+          "fit",
+          keep,
+          size,
+          bytes
+        );
+        return false;
+    }
+
+    return true;
+}
+
+bool check_update(const Wire_format& format, std::mt19937_64& random)
+{
+    const auto& quantization = format.quantization();
+    std::uniform_real_distribution<double> position(
+      -in_range(quantization.position_resolution, quantization.position_bits),
+      in_range(quantization.position_resolution, quantization.position_bits)
+    );
+    std::uniform_real_distribution<double> velocity(
+      -in_range(quantization.velocity_resolution, quantization.velocity_bits),
+      in_range(quantization.velocity_resolution, quantization.velocity_bits)
+    );
+    std::uniform_int_distribution<std::size_t> count(0, 200);
+    std::geometric_distribution<uint32_t> gap(0.1);
+    std::bernoulli_distribution reused(0.5);
+    std::uniform_int_distribution<uint32_t> generation(
+      1, std::numeric_limits<uint32_t>::max() - 1
+    );
+
+    // In increasing slots, half of them reused
+    uint32_t index{0};
+    const auto next_id = [&]() {
+        index += gap(random);
+        return make_entity_id(index++, reused(random) ? generation(random) : 0);
+    };
+
+    auto storage = std::make_shared<Update_storage>();
+    for (auto i = count(random); i > 0; --i) {
+        storage->states.push_back(
+          {.position = position(random),
+           .id = next_id(),
+           .velocity = velocity(random)}
+        );
+    }
+    for (auto i = count(random); i > 0; --i) {
+        storage->removed.push_back(next_id());
+    }
+
+    Server_update update;
+    update.storage = storage;
+    update.states = storage->states;
+    update.removed = storage->removed;
+    update.tick = static_cast<uint32_t>(random());
+    update.baseline_tick = update.tick / 2;
+    update.last_processed_input = static_cast<uint32_t>(random());
+
+    std::vector<std::byte> buffer(format.max_size(update));
+    buffer.resize(format.encode(update, buffer));
+
+    Server_update decoded;
+    Update_storage decoded_storage;
+    if (buffer.empty() || !format.decode(buffer, decoded, decoded_storage)) {
+        spdlog::error("[test] update failed to round trip");
+        return false;
+    }
+
+    if (decoded.tick != update.tick ||
+        decoded.baseline_tick != update.baseline_tick ||
+        decoded.last_processed_input != update.last_processed_input ||
+        decoded.states.size() != update.states.size() ||
+        decoded.removed.size() != update.removed.size()) {
+        spdlog::error("[test] update header or counts changed in a round trip");
+        return false;
+    }
+
+    for (std::size_t i = 0; i < update.states.size(); ++i) {
+        const auto& sent = update.states[i];
+        const auto& received = decoded.states[i];
+        if (received.id != sent.id) {
+            spdlog::error(
+              "[test] state id {} came back as {}", sent.id, received.id
+            );
+            return false;
+        }
+
+        const double position_error = std::abs(received.position - sent.position);
+        if (position_error > format.position_error_bound()) {
+            spdlog::error(
+              "[test] position {} came back {} off, more than the bound of {}",
+              sent.position,
+              position_error,
+              format.position_error_bound()
+            );
+            return false;
+        }
+
+        const double velocity_error = std::abs(received.velocity - sent.velocity);
+        if (velocity_error > format.velocity_error_bound()) {
+            spdlog::error(
+              "[test] velocity {} came back {} off, more than the bound of {}",
+              sent.velocity,
+              velocity_error,
+              format.velocity_error_bound()
+            );
+            return false;
+        }
+    }
+
+    for (std::size_t i = 0; i < update.removed.size(); ++i) {
+        if (decoded.removed[i] != update.removed[i]) {
+            spdlog::error(
+              "[test] removed id {} came back as {}",
+              update.removed[i],
+              decoded.removed[i]
+            );
+            return false;
+        }
+    }
+
+    return check_budget(format, update, buffer.size(), random);
+}
+
+bool check_input_batch(const Wire_format& format, std::mt19937_64& random)
+{
+    const auto& quantization = format.quantization();
+    const double range =
+      in_range(quantization.duration_resolution, quantization.duration_bits);
+    std::uniform_real_distribution<double> duration(-range, range);
+    std::uniform_int_distribution<uint32_t> count(1, max_batched_inputs);
+    const auto batch_count = count(random);
+    std::uniform_int_distribution<uint32_t> last_sequence_number(
+      batch_count, std::numeric_limits<uint32_t>::max()
+    );
+
+    Input_batch batch{
+      .entity_id = random() >> 12U,
+      .last_sequence_number = last_sequence_number(random),
+      .count = batch_count,
+      .durations = {}};
+    for (uint32_t i = 0; i < batch.count; ++i) {
+        batch.durations[i] = std::chrono::duration<double>{duration(random)};
+    }
+
+    std::vector<std::byte> buffer(format.max_client_message_size());
+    buffer.resize(format.encode(batch, buffer));
+
+    Input_batch decoded{};
+    if (buffer.empty() || !format.decode(buffer, decoded)) {
+        spdlog::error("[test] input batch failed to round trip");
+        return false;
+    }
+
+    if (decoded.entity_id != batch.entity_id ||
+        decoded.last_sequence_number != batch.last_sequence_number ||
+        decoded.count != batch.count) {
+        spdlog::error("[test] input batch header changed in a round trip");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < batch.count; ++i) {
+        const double error =
+          std::abs(decoded.durations[i].count() - batch.durations[i].count());
+        if (error > format.duration_error_bound()) {
+            spdlog::error(
+              "[test] duration {} came back {} off, more than the bound of {}",
+              batch.durations[i].count(),
+              error,
+              format.duration_error_bound()
+            );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::size_t
+encoded_size(const Wire_format& format, std::span<const Entity_state> states)
+{
+    Server_update update;
+    update.states = states;
+    update.tick = 1;
+
+    std::vector<std::byte> buffer(format.max_size(update));
+    return format.encode(update, buffer);
+}
+
+// Under churn, slots are reused oldest first, so neighbouring ones share a
+// generation. Entities in them take hardly more than ones in fresh slots, and
+// max_states comes close to how many of them fit a budget without ever
+// overshooting it. Fresh slots are what estimated_size assumes, so it's exact
+// for them.
+bool check_reused_slots_stay_compact(const Wire_format& format)
+{
+    constexpr uint32_t count{100};
+    constexpr uint32_t wave{25};
+
+    std::vector<Entity_state> fresh;
+    std::vector<Entity_state> reused;
+    for (uint32_t i = 0; i < count; ++i) {
+        fresh.push_back(
+          {.position = 1.0, .id = make_entity_id(i, 0), .velocity = 1.0}
+        );
+        reused.push_back(
+          {.position = 1.0,
+           .id = make_entity_id(i, 1000 - i / wave),
+           .velocity = 1.0}
+        );
+    }
+
+    // Two bytes for each change of generation
+    const auto fresh_size = encoded_size(format, fresh);
+    const auto reused_size = encoded_size(format, reused);
+    if (fresh_size == 0 || reused_size > fresh_size + 2 * (count / wave)) {
+        spdlog::error(
+          "[test] {} states took {} bytes in fresh slots but {} in reused ones",
+          count,
+          fresh_size,
+          reused_size
+        );
+        return false;
+    }
+
+    Server_update fresh_update;
+    fresh_update.states = fresh;
+    fresh_update.tick = 1;
+    if (format.estimated_size(fresh_update) != fresh_size) {
+        spdlog::error(
+          "[test] {} states in fresh slots took {} bytes, estimated at {}",
+          count,
+          fresh_size,
+          format.estimated_size(fresh_update)
+        );
+        return false;
+    }
+
+    const auto fit = format.max_states(reused_size, reused, {});
+    if (fit > count || fit < count * 9 / 10) {
+        spdlog::error(
+          "[test] {} states fit {} bytes but max_states says {}",
+          count,
+          reused_size,
+          fit
+        );
+        return false;
+    }
+
+    return true;
+}
+
+// A batch claiming more inputs than there are sequence numbers up to its last
+// would put its first before 0, and the server's processed input near the top
+// of the range, so decode has to turn it away.
+bool check_wrapping_batch_rejected(const Wire_format& format)
+{
+    constexpr auto most = static_cast<uint32_t>(max_batched_inputs);
+    for (const uint32_t last_sequence_number : {0U, 2U, most - 1}) {
+        const Input_batch batch{
+          .entity_id = 1,
+          .last_sequence_number = last_sequence_number,
+          .count = last_sequence_number + 1,
+          .durations = {}};
+
+        std::vector<std::byte> buffer(format.max_client_message_size());
+        buffer.resize(format.encode(batch, buffer));
+
+        Input_batch decoded{};
+        if (buffer.empty() || format.decode(buffer, decoded)) {
+            spdlog::error(
+              "[test] batch of {} inputs ending at {} was accepted",
+              batch.count,
+              batch.last_sequence_number
+            );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}  // namespace
+
+int main()
+{
+    // Fixed, so a failure reproduces
+    std::mt19937_64 random(0x6e6574636f6465);
+
+    // The defaults, and a coarser format to catch bounds that only hold for them
+    const Wire_format formats[]{
+      Wire_format{},
+      Wire_format{Quantization{
+        .position_resolution = 0.5,
+        .position_bits = 12,
+        .velocity_resolution = 0.25,
+        .velocity_bits = 10,
+        .duration_resolution = 1.0 / 1000.0,
+        .duration_bits = 12}},
+    };
+
+    for (const auto& format : formats) {
+        if (!check_wrapping_batch_rejected(format) ||
+            !check_reused_slots_stay_compact(format)) {
+            return EXIT_FAILURE;
+        }
+
+        for (int i = 0; i < rounds; ++i) {
+            if (!check_update(format, random) ||
+                !check_input_batch(format, random)) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    spdlog::info(
+      "[test] {} round trips within bounds", 2 * rounds * std::size(formats)
+    );
+    return EXIT_SUCCESS;
+}